@@ -0,0 +1,322 @@
+#include "crtc.h"
+#include "promise.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace crtc;
+
+// Microbenchmarks for the value types and callback plumbing on every hot path. Each line reports wall and
+// CPU time per operation, heap allocations per operation and the p99 of the per-operation latency.
+//
+//   crtc_bench_core [filter]
+//
+// Synchronous operations are timed in batches of kBatch, so their p99 is the 99th percentile batch average.
+// Asynchronous ones keep one operation in flight and time each from enqueue to run.
+
+namespace {
+	std::atomic<uint64_t> allocations(0);
+}
+
+// Counts every allocation made through the global operator new. On Windows the library has its own CRT heap,
+// so only allocations made by inline header code are seen there.
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* pointer = malloc(size ? size : 1)) {
+		return pointer;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	free(pointer);
+}
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	const size_t kBatch = 100;
+	const size_t kSamples = 2000;
+	const size_t kRoundTrips = 20000;
+	const size_t kTimers = 10;
+
+	const char* filter = nullptr;
+
+	struct Sample {
+		double wallNs;
+		double cpuNs;
+		double allocations;
+		double p99Ns;
+	};
+
+	double Nanoseconds(Clock::time_point start, Clock::time_point end) {
+		return std::chrono::duration<double, std::nano>(end - start).count();
+	}
+
+	double Percentile(std::vector<double>& values, double percentile) {
+		if (values.empty()) {
+			return 0;
+		}
+
+		std::sort(values.begin(), values.end());
+		return values[std::min(static_cast<size_t>(values.size() * percentile), values.size() - 1)];
+	}
+
+	bool Selected(const char* name) {
+		return !filter || strstr(name, filter);
+	}
+
+	void Print(const char* name, const Sample& sample) {
+		printf("%-44s %10.1f ns %10.1f ns cpu %8.2f allocs %10.1f ns p99\n", name, sample.wallNs, sample.cpuNs, sample.allocations, sample.p99Ns);
+	}
+
+	// Runs body() kSamples * kBatch times.
+	template <typename F> void Measure(const char* name, F&& body) {
+		if (!Selected(name)) {
+			return;
+		}
+
+		std::vector<double> batches;
+		batches.reserve(kSamples);
+
+		for (size_t index = 0; index < kBatch; index++) {
+			body();
+		}
+
+		uint64_t allocated = allocations.load(std::memory_order_relaxed);
+		std::clock_t cpu = std::clock();
+		auto start = Clock::now();
+		auto last = start;
+
+		for (size_t sample = 0; sample < kSamples; sample++) {
+			for (size_t index = 0; index < kBatch; index++) {
+				body();
+			}
+
+			auto now = Clock::now();
+			batches.push_back(Nanoseconds(last, now) / kBatch);
+			last = now;
+		}
+
+		double operations = static_cast<double>(kSamples * kBatch);
+		Sample result;
+
+		result.wallNs = Nanoseconds(start, last) / operations;
+		result.cpuNs = (std::clock() - cpu) * (1e9 / CLOCKS_PER_SEC) / operations;
+		result.allocations = (allocations.load(std::memory_order_relaxed) - allocated) / operations;
+		result.p99Ns = Percentile(batches, 0.99);
+
+		Print(name, result);
+	}
+
+	// Runs start(finished) kRoundTrips times, one at a time. The operation sets finished from whichever thread completes it.
+	template <typename F> void MeasureRoundTrip(const char* name, F&& start) {
+		if (!Selected(name)) {
+			return;
+		}
+
+		std::vector<double> latencies(kRoundTrips);
+		std::atomic<bool> finished(false);
+		Clock::time_point posted;
+
+		auto run = [&](double* latency) {
+			finished.store(false, std::memory_order_relaxed);
+			posted = Clock::now();
+			start(&finished);
+
+			while (!finished.load(std::memory_order_acquire)) {
+				Module::DispatchEvents(false);
+			}
+
+			if (latency) {
+				*latency = Nanoseconds(posted, Clock::now());
+			}
+		};
+
+		for (size_t index = 0; index < kBatch; index++) {
+			run(nullptr);
+		}
+
+		uint64_t allocated = allocations.load(std::memory_order_relaxed);
+		std::clock_t cpu = std::clock();
+		auto begin = Clock::now();
+
+		for (size_t index = 0; index < kRoundTrips; index++) {
+			run(&latencies[index]);
+		}
+
+		auto end = Clock::now();
+		Sample result;
+
+		result.wallNs = Nanoseconds(begin, end) / kRoundTrips;
+		result.cpuNs = (std::clock() - cpu) * (1e9 / CLOCKS_PER_SEC) / kRoundTrips;
+		result.allocations = static_cast<double>(allocations.load(std::memory_order_relaxed) - allocated) / kRoundTrips;
+		result.p99Ns = Percentile(latencies, 0.99);
+
+		Print(name, result);
+	}
+}
+
+int main(int argc, char** argv) {
+	filter = (argc > 1) ? argv[1] : nullptr;
+
+	Module::Init();
+
+	printf("%-44s %13s %17s %15s %17s\n", "benchmark", "wall/op", "cpu/op", "allocs/op", "latency");
+
+	// ArrayBuffer
+
+	Measure("ArrayBuffer::New(64)", []() {
+		auto buffer = ArrayBuffer::New(64);
+	});
+
+	Measure("ArrayBuffer::New(64 KiB)", []() {
+		auto buffer = ArrayBuffer::New(64 * 1024);
+	});
+
+	auto source = ArrayBuffer::New(64 * 1024);
+
+	Measure("ArrayBuffer::Slice(1 KiB)", [&source]() {
+		auto slice = source->Slice(1024, 2048);
+	});
+
+	// TypedArray
+
+	Int16Array samples(4096);
+	int64_t sum = 0;
+
+	Measure("Int16Array::operator[] x4096", [&samples, &sum]() {
+		for (size_t index = 0; index < samples.Length(); index++) {
+			sum += samples[index];
+		}
+	});
+
+	Measure("Int16Array copy", [&samples]() {
+		Int16Array copy(samples);
+	});
+
+	Measure("Int16Array(ArrayBuffer)", [&source]() {
+		Int16Array view(source);
+	});
+
+	// String
+
+	Measure("String(const char*)", []() {
+		String text("stun:stun.l.google.com:19302");
+	});
+
+	String text("stun:stun.l.google.com:19302");
+
+	Measure("String copy", [&text]() {
+		String copy(text);
+	});
+
+	// synchronized_callback
+
+	synchronized_callback<int> callback([&sum](int value) { sum += value; });
+
+	Measure("synchronized_callback<int>::operator()", [&callback]() {
+		callback(1);
+	});
+
+	// Error
+
+	Measure("Error::New", []() {
+		auto error = Error::New("benchmark", __FILE__, __LINE__);
+	});
+
+	// Async::Call and Promise round trips
+
+	auto main = Executor::Main();
+	auto loop = Executor::NewLoop("bench");
+	auto pool = Executor::NewPool(2);
+
+	MeasureRoundTrip("Async::Call -> module loop", [&main](std::atomic<bool>* finished) {
+		Async::Call(main, [finished]() { finished->store(true, std::memory_order_release); });
+	});
+
+	MeasureRoundTrip("Async::Call -> NewLoop", [&loop](std::atomic<bool>* finished) {
+		Async::Call(loop, [finished]() { finished->store(true, std::memory_order_release); });
+	});
+
+	MeasureRoundTrip("Async::Call -> NewPool", [&pool](std::atomic<bool>* finished) {
+		Async::Call(pool, [finished]() { finished->store(true, std::memory_order_release); });
+	});
+
+	MeasureRoundTrip("Promise::New + Then -> module loop", [&main](std::atomic<bool>* finished) {
+		Promise<int>::New(main, [](Promise<int>::Resolve resolve, Promise<int>::Reject) {
+			resolve(1);
+		})->Then([finished](int) {
+			finished->store(true, std::memory_order_release);
+		});
+	});
+
+	MeasureRoundTrip("Promise resolved from NewLoop", [&main, &loop](std::atomic<bool>* finished) {
+		auto promise = std::make_shared<Promise<int>>(main);
+
+		promise->Then([finished](int) {
+			finished->store(true, std::memory_order_release);
+		});
+
+		Async::Call(loop, [promise]() {
+			Promise<int>::Resolve resolve(promise);
+			resolve(1);
+		});
+	});
+
+	// A short timer scheduled from another thread while the module loop waits on an empty wheel. Each sample
+	// blocks in DispatchEvents(true) for up to a second, the lateness is what counts.
+
+	if (Selected("Async::Call(10 ms) -> idle module loop")) {
+		std::vector<double> lateness;
+
+		for (size_t index = 0; index < kTimers; index++) {
+			std::atomic<bool> finished(false);
+			Clock::time_point due;
+
+			Async::Call(loop, [&main, &finished, &due, &lateness]() {
+				// Lets the module loop enter its wait first.
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				due = Clock::now() + std::chrono::milliseconds(10);
+
+				Async::Call(main, [&finished, &due, &lateness]() {
+					lateness.push_back(Nanoseconds(due, Clock::now()));
+					finished.store(true, std::memory_order_release);
+				}, 10);
+			});
+
+			while (!finished.load(std::memory_order_acquire)) {
+				Module::DispatchEvents(true);
+			}
+		}
+
+		double total = 0;
+
+		for (double value : lateness) {
+			total += value;
+		}
+
+		printf("%-44s %10.1f ns late %10.1f ns p99\n", "Async::Call(10 ms) -> idle module loop", total / lateness.size(), Percentile(lateness, 0.99));
+	}
+
+	loop.reset();
+	pool.reset();
+
+	Module::Dispose();
+	return (sum < 0) ? 1 : 0;
+}
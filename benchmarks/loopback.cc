@@ -0,0 +1,352 @@
+#include "crtc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace crtc;
+
+// Connects pairs of peers inside the process and reports, as JSON on stdout:
+// connection setup time, data channel throughput and data channel round trip percentiles.
+//
+//   crtc_bench_loopback [pairs=10] [messages=10000] [messageSize=1024] [pings=1000] [dataChannelsOnly=0]
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	const uint64_t kHighWaterMark = 4 * 1024 * 1024;
+	const uint64_t kLowWaterMark = 1024 * 1024;
+	const int kTimeoutMs = 30000;
+
+	double Elapsed(Clock::time_point start, Clock::time_point end = Clock::now()) {
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	int64_t NowUs() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	double Percentile(std::vector<double> values, double percentile) {
+		if (values.empty()) {
+			return 0;
+		}
+
+		std::sort(values.begin(), values.end());
+		size_t rank = std::min(static_cast<size_t>(values.size() * percentile), values.size() - 1);
+		return values[rank];
+	}
+
+	void PrintSummary(const char* name, const std::vector<double>& values, bool last = false) {
+		double sum = 0;
+
+		for (double value : values) {
+			sum += value;
+		}
+
+		printf("  \"%s\": {\"count\": %zu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+			name, values.size(), values.empty() ? 0 : sum / values.size(), Percentile(values, 0.5), Percentile(values, 0.9),
+			Percentile(values, 0.99), Percentile(values, 1.0), last ? "" : ",");
+	}
+
+	// Runs the module loop, which delivers the offer/answer callbacks, until done() or the timeout.
+	template <typename F> bool RunUntil(F done) {
+		auto start = Clock::now();
+
+		while (!done()) {
+			if (Elapsed(start) > kTimeoutMs) {
+				return false;
+			}
+
+			if (!Module::DispatchEvents(false)) {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+
+		return true;
+	}
+
+	// Data channel callbacks run on each peer's signaling thread, so everything they touch is atomic or locked.
+	struct Pair {
+		std::shared_ptr<RTCPeerConnection> offerer;
+		std::shared_ptr<RTCPeerConnection> answerer;
+		std::shared_ptr<RTCDataChannel> local;
+		std::shared_ptr<RTCDataChannel> remote;
+
+		Clock::time_point started;
+		std::atomic<bool> open{ false };
+		std::atomic<bool> failed{ false };
+		double setupMs = 0;
+
+		std::mutex mutex;
+		std::shared_ptr<ArrayBuffer> payload;
+		size_t toSend = 0;
+		std::atomic<uint64_t> received{ 0 };
+
+		std::vector<double> rtts;
+		size_t pings = 0;
+		std::atomic<bool> pinged{ false };
+
+		void Fail(const std::shared_ptr<Error>& error) {
+			if (error) {
+				fprintf(stderr, "%s\n", error->Message().c_str());
+			}
+
+			failed = true;
+		}
+
+		void Connect(const RTCPeerConnection::RTCConfiguration& config) {
+			started = Clock::now();
+
+			offerer = RTCPeerConnection::New(config);
+			answerer = RTCPeerConnection::New(config);
+
+			if (!offerer || !answerer) {
+				return Fail(nullptr);
+			}
+
+			auto offererRef = offerer;
+			auto answererRef = answerer;
+
+			offerer->onIceCandidate([answererRef](const std::shared_ptr<RTCPeerConnection::RTCIceCandidate> candidate) {
+				answererRef->AddIceCandidate(*candidate);
+			});
+
+			answerer->onIceCandidate([offererRef](const std::shared_ptr<RTCPeerConnection::RTCIceCandidate> candidate) {
+				offererRef->AddIceCandidate(*candidate);
+			});
+
+			answerer->onDataChannel([this](const std::shared_ptr<RTCDataChannel> channel) {
+				std::lock_guard<std::mutex> lock(mutex);
+				remote = channel;
+			});
+
+			local = offerer->CreateDataChannel("bench");
+
+			local->onOpen([this]() {
+				setupMs = Elapsed(started);
+				open = true;
+			});
+
+			offerer->CreateOffer([this](std::shared_ptr<Error> error, RTCPeerConnection::RTCSessionDescription* offer) {
+				if (error) {
+					return Fail(error);
+				}
+
+				auto sdp = std::make_shared<RTCPeerConnection::RTCSessionDescription>(*offer);
+
+				offerer->SetLocalDescription(sdp, [this](std::shared_ptr<Error> error) { if (error) Fail(error); });
+				answerer->SetRemoteDescription(sdp, [this](std::shared_ptr<Error> error) {
+					if (error) {
+						return Fail(error);
+					}
+
+					answerer->CreateAnswer([this](std::shared_ptr<Error> error, RTCPeerConnection::RTCSessionDescription* answer) {
+						if (error) {
+							return Fail(error);
+						}
+
+						auto sdp = std::make_shared<RTCPeerConnection::RTCSessionDescription>(*answer);
+
+						answerer->SetLocalDescription(sdp, [this](std::shared_ptr<Error> error) { if (error) Fail(error); });
+						offerer->SetRemoteDescription(sdp, [this](std::shared_ptr<Error> error) { if (error) Fail(error); });
+					});
+				});
+			});
+		}
+
+		// Sends until the SCTP buffer reaches the high water mark, WebRTC closes channels whose buffer overflows.
+		void Pump() {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			while (toSend && local->BufferedAmount() < kHighWaterMark) {
+				local->Send(payload);
+				toSend--;
+			}
+		}
+
+		void StartThroughput(size_t messages, size_t messageSize) {
+			payload = ArrayBuffer::New(messageSize);
+			toSend = messages;
+
+			remote->onMessage([this](std::shared_ptr<ArrayBuffer> buffer, bool) {
+				received.fetch_add(buffer->ByteLength(), std::memory_order_relaxed);
+			});
+
+			local->SetBufferedAmountLowThreshold(kLowWaterMark);
+			local->onBufferedAmountLow([this]() { Pump(); });
+
+			Pump();
+		}
+
+		// One ping in flight per pair, the answerer echoes it back.
+		void StartLatency(size_t count) {
+			pings = count;
+			rtts.reserve(count);
+
+			auto remoteRef = remote;
+
+			remote->onMessage([remoteRef](std::shared_ptr<ArrayBuffer> buffer, bool binary) {
+				remoteRef->Send(buffer, binary);
+			});
+
+			local->onMessage([this](std::shared_ptr<ArrayBuffer> buffer, bool) {
+				int64_t sent = 0;
+				memcpy(&sent, buffer->Data(), sizeof(sent));
+
+				std::lock_guard<std::mutex> lock(mutex);
+				rtts.push_back(static_cast<double>(NowUs() - sent));
+
+				if (rtts.size() < pings) {
+					Ping();
+				}
+				else {
+					pinged = true;
+				}
+			});
+
+			Ping();
+		}
+
+		void Ping() {
+			int64_t now = NowUs();
+			local->Send(reinterpret_cast<const unsigned char*>(&now), sizeof(now));
+		}
+	};
+}
+
+int main(int argc, char** argv) {
+	size_t pairCount = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 10;
+	size_t messages = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 10000;
+	size_t messageSize = (argc > 3) ? strtoul(argv[3], nullptr, 10) : 1024;
+	size_t pings = (argc > 4) ? strtoul(argv[4], nullptr, 10) : 1000;
+
+	RTCPeerConnection::RTCConfiguration config;
+	config.dataChannelsOnly = (argc > 5) && strtoul(argv[5], nullptr, 10);
+
+	Module::Options options;
+	options.logSeverity = Module::kLogError;
+	Module::Init(options);
+
+	std::vector<std::unique_ptr<Pair>> pairs;
+
+	for (size_t index = 0; index < pairCount; index++) {
+		pairs.emplace_back(new Pair());
+	}
+
+	auto start = Clock::now();
+
+	for (const auto& pair : pairs) {
+		pair->Connect(config);
+	}
+
+	bool connected = RunUntil([&pairs]() {
+		for (const auto& pair : pairs) {
+			if (pair->failed || !pair->open) {
+				return pair->failed.load();
+			}
+
+			std::lock_guard<std::mutex> lock(pair->mutex);
+
+			if (!pair->remote) {
+				return false;
+			}
+		}
+
+		return true;
+	});
+
+	double connectAllMs = Elapsed(start);
+
+	for (const auto& pair : pairs) {
+		connected = connected && !pair->failed;
+	}
+
+	if (!connected) {
+		fprintf(stderr, "failed to connect all pairs\n");
+		Module::Dispose();
+		return 1;
+	}
+
+	std::vector<double> setup;
+
+	for (const auto& pair : pairs) {
+		setup.push_back(pair->setupMs);
+	}
+
+	// Throughput, every pair sending at once.
+	uint64_t expected = static_cast<uint64_t>(messages) * messageSize;
+
+	start = Clock::now();
+
+	for (const auto& pair : pairs) {
+		pair->StartThroughput(messages, messageSize);
+	}
+
+	bool delivered = RunUntil([&pairs, expected]() {
+		for (const auto& pair : pairs) {
+			if (pair->received.load(std::memory_order_relaxed) < expected) {
+				return false;
+			}
+		}
+
+		return true;
+	});
+
+	double throughputMs = Elapsed(start);
+	uint64_t bytes = 0;
+
+	for (const auto& pair : pairs) {
+		bytes += pair->received.load();
+	}
+
+	// Round trips, every pair ping-ponging at once.
+	for (const auto& pair : pairs) {
+		pair->StartLatency(pings);
+	}
+
+	bool ponged = RunUntil([&pairs]() {
+		for (const auto& pair : pairs) {
+			if (!pair->pinged) {
+				return false;
+			}
+		}
+
+		return true;
+	});
+
+	std::vector<double> rtts;
+
+	for (const auto& pair : pairs) {
+		std::lock_guard<std::mutex> lock(pair->mutex);
+		rtts.insert(rtts.end(), pair->rtts.begin(), pair->rtts.end());
+	}
+
+	double seconds = throughputMs / 1000;
+
+	printf("{\n");
+	printf("  \"pairs\": %zu,\n", pairs.size());
+	printf("  \"dataChannelsOnly\": %s,\n", config.dataChannelsOnly ? "true" : "false");
+	printf("  \"connectAllMs\": %.3f,\n", connectAllMs);
+	PrintSummary("setupMs", setup);
+	printf("  \"dataChannel\": {\"complete\": %s, \"messageSize\": %zu, \"bytes\": %llu, \"seconds\": %.3f, \"megabitsPerSecond\": %.3f, \"messagesPerSecond\": %.1f},\n",
+		delivered ? "true" : "false", messageSize, static_cast<unsigned long long>(bytes), seconds,
+		seconds > 0 ? bytes * 8 / seconds / 1e6 : 0, seconds > 0 && messageSize ? bytes / messageSize / seconds : 0);
+	printf("  \"roundTripComplete\": %s,\n", ponged ? "true" : "false");
+	PrintSummary("roundTripUs", rtts, true);
+	printf("}\n");
+
+	for (const auto& pair : pairs) {
+		pair->offerer->Close();
+		pair->answerer->Close();
+	}
+
+	pairs.clear();
+	Module::Dispose();
+	return (delivered && ponged) ? 0 : 1;
+}
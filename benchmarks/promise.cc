@@ -0,0 +1,162 @@
+#include "crtc.h"
+#include "promise.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace crtc;
+
+namespace {
+	// The Promise implementation this one replaced, kept verbatim for comparison.
+	template <typename... Args> class LegacyPromise {
+		LegacyPromise(const LegacyPromise&) = delete;
+		LegacyPromise& operator=(const LegacyPromise&) = delete;
+
+	public:
+		typedef std::function<void(Args...)> FullFilledCallback;
+		typedef std::function<void()> FinallyCallback;
+		typedef std::function<void(std::shared_ptr<Error>)> RejectedCallback;
+		typedef std::function<void(const FullFilledCallback&, const RejectedCallback&)> ExecutorCallback;
+
+		explicit LegacyPromise() : _completed(false) { }
+
+		static std::shared_ptr<LegacyPromise<Args...>> New(const std::shared_ptr<Executor>& target, const ExecutorCallback& executor) {
+			auto self = std::make_shared<LegacyPromise<Args...>>();
+
+			RejectedCallback reject([=](const std::shared_ptr<Error>& error) {
+				for (const auto& callback : self->_onreject) {
+					callback(error);
+				}
+
+				for (const auto& callback : self->_onfinally) {
+					callback();
+				}
+
+				self->_completed = true;
+				self->_onfinally.clear();
+				self->_onreject.clear();
+				self->_onresolve.clear();
+				self->_cnd.notify_all();
+			});
+
+			FullFilledCallback resolve([=](Args... args) {
+				for (const auto& callback : self->_onresolve) {
+					callback(std::move(args)...);
+				}
+
+				for (const auto& callback : self->_onfinally) {
+					callback();
+				}
+
+				self->_completed = true;
+				self->_onfinally.clear();
+				self->_onreject.clear();
+				self->_onresolve.clear();
+				self->_cnd.notify_all();
+			});
+
+			Async::Call(target, [=]() { executor(resolve, reject); });
+			return self;
+		}
+
+		LegacyPromise<Args...>* Then(const FullFilledCallback& callback) {
+			_onresolve.push_back(callback);
+			return this;
+		}
+
+		LegacyPromise<Args...>* Catch(const RejectedCallback& callback) {
+			_onreject.push_back(callback);
+			return this;
+		}
+
+	private:
+		std::condition_variable _cnd;
+		std::mutex _mtx;
+		bool _completed;
+
+		std::vector<FullFilledCallback> _onresolve;
+		std::vector<RejectedCallback> _onreject;
+		std::vector<FinallyCallback> _onfinally;
+	};
+
+	const int kIterations = 200000;
+
+	template <typename F> void Measure(const char* name, F&& body) {
+		size_t completed = 0;
+		auto start = std::chrono::steady_clock::now();
+
+		for (int index = 0; index < kIterations; index++) {
+			body(completed);
+		}
+
+		while (completed < static_cast<size_t>(kIterations)) {
+			Module::DispatchEvents(false);
+		}
+
+		auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		printf("%-40s %10.1f ns/op\n", name, elapsed / kIterations);
+	}
+}
+
+int main() {
+	Module::Init();
+
+	auto executor = Executor::Main();
+
+	Measure("legacy: New + Then + Catch", [&](size_t& completed) {
+		LegacyPromise<int>::New(executor, [](const LegacyPromise<int>::FullFilledCallback& resolve, const LegacyPromise<int>::RejectedCallback&) {
+			resolve(1);
+		})->Then([&completed](int value) {
+			completed += value;
+		})->Catch([](std::shared_ptr<Error>) { });
+	});
+
+	Measure("promise: New + Then + Catch", [&](size_t& completed) {
+		Promise<int>::New(executor, [](Promise<int>::Resolve resolve, Promise<int>::Reject) {
+			resolve(1);
+		})->Then([&completed](int value) {
+			completed += value;
+		})->Catch([](std::shared_ptr<Error>) { });
+	});
+
+	Measure("promise: New + Then + Then (chained)", [&](size_t& completed) {
+		Promise<int>::New(executor, [](Promise<int>::Resolve resolve, Promise<int>::Reject) {
+			resolve(1);
+		})->Then([](int value) {
+			return value;
+		})->Then([&completed](int value) {
+			completed += value;
+		});
+	});
+
+	// Settled from a foreign thread like WebRTC observers do, continuations hop back to the module loop.
+	std::vector<std::shared_ptr<Promise<int>>> pending;
+	pending.reserve(kIterations);
+
+	Measure("promise: resolve from another thread", [&](size_t& completed) {
+		auto promise = std::make_shared<Promise<int>>(executor);
+
+		promise->Then([&completed](int value) {
+			completed += value;
+		});
+
+		pending.push_back(promise);
+
+		if (pending.size() == static_cast<size_t>(kIterations)) {
+			std::thread thread([&pending]() {
+				for (const auto& promise : pending) {
+					Promise<int>::Resolve resolve(promise);
+					resolve(1);
+				}
+			});
+
+			thread.join();
+			pending.clear();
+		}
+	});
+
+	Module::Dispose();
+	return 0;
+}
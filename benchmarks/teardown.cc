@@ -0,0 +1,110 @@
+#include "crtc.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
+using namespace crtc;
+
+namespace {
+	// Entries of a /proc/self directory, -1 where that is not available.
+	long CountEntries(const char* path) {
+#if defined(__linux__)
+		DIR* dir = opendir(path);
+		long count = 0;
+
+		if (!dir) {
+			return -1;
+		}
+
+		while (readdir(dir)) {
+			count++;
+		}
+
+		closedir(dir);
+		return count - 2;
+#else
+		(void)path;
+		return -1;
+#endif
+	}
+
+	double Elapsed(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100;
+
+	Module::Init();
+
+	long fds = CountEntries("/proc/self/fd");
+	long threads = CountEntries("/proc/self/task");
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::shared_ptr<RTCPeerConnection>> peers;
+
+	for (size_t index = 0; index < count; index++) {
+		auto peer = RTCPeerConnection::New();
+
+		if (peer) {
+			peer->CreateDataChannel("bench");
+			peers.push_back(peer);
+		}
+	}
+
+	printf("created %zu peers in %.1f ms (fds %+ld, threads %+ld)\n", peers.size(), Elapsed(start),
+		CountEntries("/proc/self/fd") - fds, CountEntries("/proc/self/task") - threads);
+
+	size_t closed = 0;
+	size_t misordered = 0;
+	std::vector<char> offered(peers.size(), 0);
+	start = std::chrono::steady_clock::now();
+
+	// The offer is still pending when Close() is called, its callback has to arrive first.
+	for (size_t index = 0; index < peers.size(); index++) {
+		peers[index]->CreateOffer([&offered, index](std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*) {
+			offered[index] = 1;
+		});
+
+		peers[index]->Close([&closed, &misordered, &offered, index]() {
+			misordered += offered[index] ? 0 : 1;
+			closed++;
+		});
+	}
+
+	// Time spent on the calling thread, the rest happens on the peers' own threads.
+	double issued = Elapsed(start);
+
+	while (closed < peers.size()) {
+		Module::DispatchEvents(false);
+	}
+
+	double drained = Elapsed(start);
+
+	peers.clear();
+
+	double released = Elapsed(start);
+
+	// Threads and sockets are released on the teardown thread.
+	while (Module::DispatchEvents(false) && (CountEntries("/proc/self/task") > threads + 1 || CountEntries("/proc/self/fd") > fds)) { }
+
+	printf("close issued %.1f ms, closed %.1f ms, references dropped %.1f ms, resources released %.1f ms\n",
+		issued, drained, released, Elapsed(start));
+
+	printf("remaining fds %+ld, threads %+ld (teardown thread included)\n",
+		CountEntries("/proc/self/fd") - fds, CountEntries("/proc/self/task") - threads);
+
+	if (misordered) {
+		printf("FAILED: %zu close callbacks ran before the pending offer's callback\n", misordered);
+	}
+
+	Module::Dispose();
+	return misordered ? 1 : 0;
+}
@@ -55,10 +55,21 @@ WebRTC uses Real-Time Protocol to transfer audio and video.
 #define CRTC_NO_EXPORT __attribute__((visibility("hidden")))
 #endif
 
+#include <cstddef>
 #include <memory>
+#include <new>
 #include <vector>
 #include <string>
 #include <functional>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define CRTC_COROUTINES 1
+#endif
+#endif
 
 namespace crtc {
 
@@ -143,36 +154,164 @@ namespace crtc {
 		static double Since(int64_t begin, int64_t end = Now()); // returns seconds
 	};
 
+	/// Move-only callback. Callables up to six pointers in size are stored inline, larger ones are moved to the heap.
+
+	class Task {
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+	public:
+		Task() noexcept : _ops(nullptr) { }
+		Task(std::nullptr_t) noexcept : _ops(nullptr) { }
+
+		template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+		Task(F&& func) : _ops(nullptr) {
+			typedef typename std::decay<F>::type Callable;
+
+			Init<Callable>(std::forward<F>(func), std::integral_constant<bool,
+				sizeof(Callable) <= sizeof(Storage) && alignof(Callable) <= alignof(Storage) && std::is_nothrow_move_constructible<Callable>::value>());
+		}
+
+		Task(Task&& other) noexcept : _ops(other._ops) {
+			if (_ops) {
+				_ops->move(&other._storage, &_storage);
+				other._ops = nullptr;
+			}
+		}
+
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other) {
+				Reset();
+
+				if (other._ops) {
+					other._ops->move(&other._storage, &_storage);
+					_ops = other._ops;
+					other._ops = nullptr;
+				}
+			}
+
+			return *this;
+		}
+
+		~Task() {
+			Reset();
+		}
+
+		explicit operator bool() const noexcept {
+			return _ops != nullptr;
+		}
+
+		void operator()() {
+			if (_ops) {
+				_ops->invoke(&_storage);
+			}
+		}
+
+		void Reset() noexcept {
+			if (_ops) {
+				_ops->destroy(&_storage);
+				_ops = nullptr;
+			}
+		}
+
+	private:
+		struct Ops {
+			void (*invoke)(void* storage);
+			void (*move)(void* from, void* to);
+			void (*destroy)(void* storage);
+		};
+
+		template <typename F> struct Inline {
+			static void invoke(void* storage) { (*static_cast<F*>(storage))(); }
+			static void move(void* from, void* to) { new (to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F(); }
+			static void destroy(void* storage) { static_cast<F*>(storage)->~F(); }
+			static const Ops ops;
+		};
+
+		template <typename F> struct Heap {
+			static void invoke(void* storage) { (**static_cast<F**>(storage))(); }
+			static void move(void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); }
+			static void destroy(void* storage) { delete *static_cast<F**>(storage); }
+			static const Ops ops;
+		};
+
+		typedef typename std::aligned_storage<6 * sizeof(void*), alignof(std::max_align_t)>::type Storage;
+
+		template <typename Callable, typename F> void Init(F&& func, std::true_type) {
+			new (&_storage) Callable(std::forward<F>(func));
+			_ops = &Inline<Callable>::ops;
+		}
+
+		template <typename Callable, typename F> void Init(F&& func, std::false_type) {
+			*reinterpret_cast<Callable**>(&_storage) = new Callable(std::forward<F>(func));
+			_ops = &Heap<Callable>::ops;
+		}
+
+		const Ops* _ops;
+		Storage _storage;
+	};
+
+	template <typename F> const Task::Ops Task::Inline<F>::ops = { &Task::Inline<F>::invoke, &Task::Inline<F>::move, &Task::Inline<F>::destroy };
+	template <typename F> const Task::Ops Task::Heap<F>::ops = { &Task::Heap<F>::invoke, &Task::Heap<F>::move, &Task::Heap<F>::destroy };
+
+	/// Target of asynchronous callbacks. Unless Module::Init() is given dispatcher threads every callback runs on the module loop.
+
+	class CRTC_EXPORT Executor {
+		Executor(const Executor&) = delete;
+		Executor& operator=(const Executor&) = delete;
+
+	public:
+		explicit Executor() { }
+		virtual ~Executor() { }
+
+		/// Module loop, processed by the thread calling Module::DispatchEvents().
+		static std::shared_ptr<Executor> Main();
+
+		/// Executor used by Async::Call() when no target is given.
+		static std::shared_ptr<Executor> Default();
+
+		/// Executor running the calling thread, or Default() outside of any executor.
+		static std::shared_ptr<Executor> Current();
+
+		/// Event loop on a dedicated thread, e.g. one per peer connection.
+		static std::shared_ptr<Executor> NewLoop(const String& name = String("loop"));
+
+		/// Work-stealing pool. 0 threads uses one thread per core.
+		static std::shared_ptr<Executor> NewPool(size_t threads = 0);
+
+		virtual void Post(Task task, int delayMs = 0) = 0;
+		virtual bool IsCurrent() const = 0;
+	};
+
 	class CRTC_EXPORT Async {
 		explicit Async() = delete;
 		Async(const Async&) = delete;
 		Async& operator=(const Async&) = delete;
 	public:
-		static void Call(std::function<void()> callback, int delayMs = 0);
+		static void Call(Task task, int delayMs = 0);
+		static void Call(const std::shared_ptr<Executor>& executor, Task task, int delayMs = 0);
+
+		/// Runs the task once after delayMs. Returns a non-zero handle for Async::Cancel().
+		static uint64_t Timeout(Task task, int delayMs, const std::shared_ptr<Executor>& executor = nullptr);
+		static bool Cancel(uint64_t timeout);
 	};
 
 	/// \sa https://developer.mozilla.org/en/docs/Web/API/Window/SetImmediate
 
 	template <typename F, typename... Args> static inline void SetImmediate(F&& func, Args... args) {
-		std::function<void(Args...)> callback(func);
-
-		Async::Call(Callback([=]() {
-			callback(args...);
-			}, [=]() {
-				callback(args...);
-				}));
+		Async::Call(std::bind(std::forward<F>(func), std::move(args)...));
 	}
 
 	/// \sa https://developer.mozilla.org/en-US/docs/Web/API/WindowTimers/setTimeout
 
-	template <typename F, typename... Args> static inline void SetTimeout(F&& func, int delay, Args... args) {
-		std::function<void(Args... args)> callback(func);
+	template <typename F, typename... Args> static inline uint64_t SetTimeout(F&& func, int delay, Args... args) {
+		return Async::Timeout(std::bind(std::forward<F>(func), std::move(args)...), (delay > 0) ? delay : 0);
+	}
+
+	/// \sa https://developer.mozilla.org/en-US/docs/Web/API/clearTimeout
 
-		Async::Call(Callback([=]() {
-			callback(args...);
-			}, [=]() {
-				callback(args...);
-				}), (delay > 0) ? delay : 0);
+	static inline bool ClearTimeout(uint64_t timeout) {
+		return Async::Cancel(timeout);
 	}
 
 	/// \sa https://developer.mozilla.org/en/docs/Web/JavaScript/Reference/Global_Objects/Error
@@ -374,11 +513,139 @@ namespace crtc {
 		Module& operator=(const Module&) = delete;
 
 	public:
-		static void Init();
+		enum LogSeverity {
+			kLogVerbose,
+			kLogInfo,
+			kLogWarning,
+			kLogError,
+			kLogNone,
+		};
+
+		enum VideoCodec {
+			kH264,
+			kVP8,
+			kVP9,
+			kAV1,
+		};
+
+		/// Trades encoder CPU for quality. Mapped onto WebRTC's encoder complexity, which each codec turns into its own speed setting.
+		enum VideoEncoderSpeed {
+			kSpeedFastest,
+			kSpeedDefault,
+			kSpeedSlower,
+			kSpeedSlowest,
+		};
+
+		struct CRTC_EXPORT VideoEncoderSettings {
+			explicit VideoEncoderSettings(VideoCodec videoCodec = kH264, VideoEncoderSpeed encoderSpeed = kSpeedDefault, int encoderThreads = 0) :
+				codec(videoCodec),
+				speed(encoderSpeed),
+				threads(encoderThreads)
+			{ }
+
+			VideoCodec codec;
+			VideoEncoderSpeed speed;
+
+			/// Upper bound of the threads per encoder, the codec may use fewer at low resolutions. 0 allows one per core.
+			int threads;
+		};
+
+		struct CRTC_EXPORT Options {
+			explicit Options();
+
+			/// Least severe WebRTC log line kept. Defaults to kLogError in release builds and kLogInfo otherwise.
+			LogSeverity logSeverity;
+
+			/// Lines are formatted into a ring buffer and written by a background thread, to stderr or to
+			/// this callback when set. The callback runs on that thread. Lines are dropped while the buffer is full.
+			std::function<void(LogSeverity severity, const char* line, size_t length)> logCallback;
+
+			/// Lines per second kept from a single call site, 0 keeps all of them.
+			uint32_t logRateLimit;
+
+			/// Threads running Async::Call() callbacks. 0 runs them on the thread calling DispatchEvents().
+			size_t dispatcherThreads;
+
+			/// Resolution of SetTimeout(). Timers due within the same window are fired together.
+			int timerSlackMs;
+
+			/// Peer connections kept constructed in the background, used by RTCPeerConnection::New() and NewBatch().
+			size_t peerConnectionPoolSize;
+
+			/// DTLS certificates kept generated in the background for connections configured without certificates.
+			/// Each one is used by a single connection unless shareCertificates is set.
+			size_t certificatePoolSize;
+
+			/// Hands the pooled certificates out round-robin, so many connections share a few keys.
+			bool shareCertificates;
+
+			/// Age at which a shared certificate is replaced by a new one. 0 never rotates them.
+			int64_t certificateRotationMs;
+
+			/// Video encoders offered by new connections, in order of preference. Codecs left out are not offered.
+			/// Defaults to H264, VP8, VP9 and AV1.
+			std::vector<VideoEncoderSettings> videoEncoders;
+
+			/// Shortest time between key frames of a shared encoder, see RTCConfiguration::videoBroadcastGroup,
+			/// and between key frame requests of a video relay, see RTCPeerConnection::CreateVideoRelay().
+			/// Key frames requested in between are merged into the next allowed one.
+			int broadcastKeyFrameIntervalMs;
+		};
+
+		/// Snapshot of the library's internal counters. Counters run from Init(), latency histograms
+		/// start recording on the first call to GetMetrics() or GetPrometheusMetrics().
+
+		struct CRTC_EXPORT Metrics {
+			struct CRTC_EXPORT Latency {
+				uint64_t count;
+				double sumUs;
+				double p50Us;
+				double p90Us;
+				double p99Us;
+				double maxUs;
+			};
+
+			uint64_t tasksPosted;
+			uint64_t tasksCompleted;
+			/// Tasks posted to an executor that have not run or been dropped yet.
+			int64_t taskQueueDepth;
+			uint64_t dispatchIterations;
+			/// CreateOffer, CreateAnswer, SetLocalDescription and SetRemoteDescription calls completed or aborted.
+			uint64_t sdpOperations;
+			uint64_t dataChannelSendFailures;
+			uint64_t framesDropped;
+			/// Audio buffers written to local audio tracks and not yet consumed by WebRTC.
+			int64_t audioQueueDepth;
+			double cpuUserSeconds;
+			double cpuSystemSeconds;
+
+			/// From Post() to the start of the task.
+			Latency taskQueueLatency;
+			/// DispatchEvents() iterations, including the wait for events when called with kForever.
+			Latency dispatchLoopTime;
+			/// From queuing an SDP operation until its result is posted to the connection's executor.
+			Latency sdpOperationLatency;
+		};
+
+		static void Init(const Options& options = Options());
 		static bool DispatchEvents(bool kForever = false);
 		static void Dispose();
 		static void RegisterAsyncCallback(const std::function<void()>& callback);
 		static void UnregisterAsyncCallback();
+
+		static Metrics GetMetrics();
+
+		/// The same snapshot in the Prometheus text exposition format.
+		static String GetPrometheusMetrics();
+
+		/// Records spans of tasks, media delivery, decoding and SDP operations (from the call until the result is
+		/// posted) into a ring of the most recent 65536 spans. Requires a library built with the CRTC_TRACING CMake option.
+
+		static void StartTracing();
+		static void StopTracing();
+
+		/// The recorded spans in the Chrome JSON trace format, for chrome://tracing or ui.perfetto.dev.
+		static String GetTrace();
 	};
 
 	class CRTC_EXPORT VideoFrame {
@@ -414,6 +681,17 @@ namespace crtc {
 			kEnded,
 		};
 
+		/// What the decoders of a remote track do with its frames. Passthrough hands the encoded frames to
+		/// onRawVideo(), onRawAudio(), the video relay and the recorder of the connection.
+		enum DecodeMode {
+			/// Decodes while onVideo() or onAudio() is set on the track, or while the connection has no passthrough
+			/// consumer. Passes through while it has one.
+			kDecodeAuto,
+			kDecodeOnly,
+			kDecodePassthrough,
+			kDecodeBoth,
+		};
+
 		explicit MediaStreamTrack();
 		virtual ~MediaStreamTrack();
 
@@ -434,6 +712,13 @@ namespace crtc {
 		virtual void onAudio(std::function<void(const void*, int, int, size_t, size_t)> callback) = 0;
 		virtual void onVideo(std::function<void(std::shared_ptr<VideoFrame>)> callback) = 0;
 		virtual void onFrameDrop(std::function<void()> callback) = 0;
+
+		/// Switches a remote track at any time, video restarts decoding at the next key frame. Audio decoders can't
+		/// tell their tracks apart, they decode while any audio track of the connection asks for it. Ignored by
+		/// local tracks.
+
+		virtual void SetDecodeMode(DecodeMode mode) = 0;
+		virtual DecodeMode GetDecodeMode() const = 0;
 	};
 
 	typedef std::vector<std::shared_ptr<MediaStreamTrack>> MediaStreamTracks;
@@ -738,29 +1023,80 @@ namespace crtc {
 			std::vector<String> urls;
 		};
 
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCCertificate
+
+		class CRTC_EXPORT RTCCertificate {
+		public:
+			enum KeyType {
+				kECDSA,
+				kRSA,
+			};
+
+			virtual ~RTCCertificate() { }
+
+			/// Milliseconds since the epoch.
+			virtual uint64_t Expires() const = 0;
+		};
+
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCConfiguration
 
 		struct CRTC_EXPORT RTCConfiguration {
 			explicit RTCConfiguration();
 			~RTCConfiguration();
 
+			/// Candidates gathered as soon as the connection is created, before SetLocalDescription() asks for them.
 			uint16_t iceCandidatePoolSize;
 			RTCBundlePolicy bundlePolicy;
 			std::vector<RTCIceServer> iceServers;
 			RTCIceTransportPolicy iceTransportPolicy;
 			RTCRtcpMuxPolicy rtcpMuxPolicy;
+
+			/// DTLS certificates from GenerateCertificate(). May be shared between connections.
+			std::vector<std::shared_ptr<RTCCertificate>> certificates;
+
+			/// Executor running this connection's asynchronous work. Defaults to Executor::Default().
+			std::shared_ptr<Executor> executor;
+
+			/// Creates the connection without audio and video engines. Only data channels can be used, offers and
+			/// answers carry no media sections and AddStream() does nothing. Such connections skip the connection pool.
+			bool dataChannelsOnly;
+
+			/// Connections in the same non-empty group share their video encoders. A frame is encoded once for
+			/// every codec and encoder configuration in use and the output is sent by each connection, so one
+			/// source sent to many connections costs one encoder instead of one per connection. Meant for
+			/// connections sending the same single video track. The shared encoder follows the lowest
+			/// bandwidth estimate of its connections and ignores their loss reports.
+			String videoBroadcastGroup;
 		};
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/createOffer#RTCOfferOptions_dictionary
 		/// \sa https://w3c.github.io/webrtc-pc/#idl-def-rtcofferansweroptions
 
 		struct CRTC_EXPORT RTCOfferAnswerOptions {
+			RTCOfferAnswerOptions() :
+				voiceActivityDetection(false),
+				offerToReceiveAudio(true),
+				offerToReceiveVideo(true)
+			{ }
+
 			bool voiceActivityDetection;
+
+			/// \sa https://w3c.github.io/webrtc-pc/#legacy-configuration-extensions
+			///
+			/// Offers add a receive-only section for the kind when no transceiver of that kind exists. When false
+			/// the sections come from the transceivers alone, answers stop receive-only transceivers of the kind
+			/// and make send-receive ones send-only.
+			bool offerToReceiveAudio;
+			bool offerToReceiveVideo;
 		};
 
 		/// \sa https://w3c.github.io/webrtc-pc/#idl-def-rtcofferoptions
 
 		struct CRTC_EXPORT RTCOfferOptions : RTCOfferAnswerOptions {
+			RTCOfferOptions() :
+				iceRestart(false)
+			{ }
+
 			bool iceRestart;
 		};
 
@@ -769,28 +1105,316 @@ namespace crtc {
 		struct CRTC_EXPORT RTCAnswerOptions : RTCOfferAnswerOptions {
 		};
 
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpEncodingParameters
+
+		struct CRTC_EXPORT RTCRtpEncodingParameters {
+			explicit RTCRtpEncodingParameters() :
+				active(true),
+				maxBitrate(0),
+				maxFramerate(0),
+				scaleResolutionDownBy(0)
+			{ }
+
+			String rid;
+			bool active;
+
+			/// Bits per second, 0 leaves the bitrate to congestion control.
+			uint32_t maxBitrate;
+
+			/// 0 sends every captured frame.
+			double maxFramerate;
+
+			/// Video only. 0 keeps the default, which is 1 for a single encoding.
+			double scaleResolutionDownBy;
+
+			/// \sa https://www.w3.org/TR/webrtc-svc/#scalabilitymodes*
+			///
+			/// Video only, e.g. "L1T3" or "L3T3_KEY" for VP9 and AV1. Empty leaves it to the encoder.
+			String scalabilityMode;
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpTransceiver/direction
+
+		enum RTCRtpTransceiverDirection {
+			kSendRecv,
+			kSendOnly,
+			kRecvOnly,
+			kInactive,
+			kStopped,
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/addTransceiver#init
+
+		struct CRTC_EXPORT RTCRtpTransceiverInit {
+			explicit RTCRtpTransceiverInit(RTCRtpTransceiverDirection transceiverDirection = kSendRecv) :
+				direction(transceiverDirection)
+			{ }
+
+			RTCRtpTransceiverDirection direction;
+
+			/// Ids of the streams the remote side adds the track to.
+			std::vector<String> streamIds;
+
+			/// One entry per simulcast layer, each with its own rid. Empty sends a single encoding.
+			std::vector<RTCRtpEncodingParameters> sendEncodings;
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpSender/getParameters
+
+		struct CRTC_EXPORT RTCRtpSendParameters {
+			std::vector<RTCRtpEncodingParameters> encodings;
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpSender
+
+		class CRTC_EXPORT RTCRtpSender {
+		public:
+			virtual ~RTCRtpSender() { }
+
+			/// nullptr once the track was removed.
+			virtual std::shared_ptr<MediaStreamTrack> Track() const = 0;
+
+			virtual RTCRtpSendParameters GetParameters() const = 0;
+
+			/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpSender/setParameters
+			///
+			/// Applied to the running encoder without renegotiation. The number of encodings and their rids can not
+			/// change. The callback runs on the connection's executor.
+			virtual void SetParameters(const RTCRtpSendParameters& parameters, std::function<void(std::shared_ptr<Error>)> callback = nullptr) = 0;
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpTransceiver
+
+		class CRTC_EXPORT RTCRtpTransceiver {
+		public:
+			virtual ~RTCRtpTransceiver() { }
+
+			/// Empty until the transceiver is negotiated.
+			virtual String Mid() const = 0;
+			virtual MediaStreamTrack::Type Kind() const = 0;
+
+			virtual std::shared_ptr<RTCRtpSender> Sender() const = 0;
+
+			virtual RTCRtpTransceiverDirection Direction() const = 0;
+
+			/// Direction negotiated by the last offer/answer, kInactive before the first one.
+			virtual RTCRtpTransceiverDirection CurrentDirection() const = 0;
+
+			/// Takes effect with the next negotiation. Returns false for stopped transceivers and kStopped.
+			virtual bool SetDirection(RTCRtpTransceiverDirection direction) = 0;
+
+			/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCRtpTransceiver/stop
+			///
+			/// Rejects the media section with the next negotiation and releases its channels.
+			virtual void Stop() = 0;
+		};
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCStatsReport
+		///
+		/// One flat record per stats object. Members that do not apply to the type, or were not reported, are 0.
+		/// Durations are in seconds and bitrates in bits per second, as in the specification.
+
+		struct CRTC_EXPORT RTCStats {
+			enum RTCStatsType {
+				kCandidatePair,
+				kInboundRtp,
+				kOutboundRtp,
+				kRemoteInboundRtp,
+				kDataChannel,
+				kTransport,
+				kPeerConnection,
+			};
+
+			enum RTCMediaKind {
+				kUnknown,
+				kAudio,
+				kVideo,
+			};
+
+			explicit RTCStats(RTCStatsType statsType = kPeerConnection) :
+				type(statsType),
+				kind(kUnknown),
+				timestampUs(0),
+				ssrc(0),
+				packetsSent(0),
+				packetsReceived(0),
+				bytesSent(0),
+				bytesReceived(0),
+				packetsLost(0),
+				fractionLost(0),
+				jitter(0),
+				roundTripTime(0),
+				availableOutgoingBitrate(0),
+				targetBitrate(0),
+				framesEncoded(0),
+				framesDecoded(0),
+				framesDropped(0),
+				keyFramesEncoded(0),
+				keyFramesDecoded(0),
+				framesPerSecond(0),
+				messagesSent(0),
+				messagesReceived(0),
+				dataChannelsOpened(0),
+				dataChannelsClosed(0)
+			{ }
+
+			RTCStatsType type;
+			RTCMediaKind kind;
+			int64_t timestampUs;
+
+			/// Left empty when RTCStatsOptions::cheap is set.
+			String id;
+			String trackId;
+
+			uint32_t ssrc;
+			uint64_t packetsSent;
+			uint64_t packetsReceived;
+			uint64_t bytesSent;
+			uint64_t bytesReceived;
+			int64_t packetsLost;
+			double fractionLost;
+			double jitter;
+			double roundTripTime;
+			double availableOutgoingBitrate;
+			double targetBitrate;
+			uint32_t framesEncoded;
+			uint32_t framesDecoded;
+			uint32_t framesDropped;
+			uint32_t keyFramesEncoded;
+			uint32_t keyFramesDecoded;
+			double framesPerSecond;
+			uint32_t messagesSent;
+			uint32_t messagesReceived;
+			uint32_t dataChannelsOpened;
+			uint32_t dataChannelsClosed;
+		};
+
+		typedef std::vector<RTCStats> RTCStatsReport;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/getStats#parameters
+
+		struct CRTC_EXPORT RTCStatsOptions {
+			explicit RTCStatsOptions() :
+				cheap(false)
+			{ }
+
+			/// Restricts the report to the sender or receiver of this track and the objects it references.
+			std::shared_ptr<MediaStreamTrack> track;
+
+			/// Reports only the RTP streams, the selected candidate pair and the data channels, without ids or
+			/// track ids. WebRTC still collects the full report, only flattening and copying it is cheaper, use
+			/// track to narrow down what WebRTC collects.
+			bool cheap;
+		};
+
+		/// Files written by Record(). Streams are written as they are received, without decoding them.
+
+		struct CRTC_EXPORT RTCRecorderOptions {
+			explicit RTCRecorderOptions() :
+				bufferSize(1 << 20),
+				maxQueuedBytes(64 << 20),
+				directIO(false)
+			{ }
+
+			/// Received video, left out when empty. VP8, VP9 and AV1 are written as IVF, H264 as an Annex B byte stream.
+			String videoPath;
+
+			/// Received Opus audio as an Ogg file, left out when empty.
+			String audioPath;
+
+			/// Size of each write, rounded up to a multiple of 4096 bytes.
+			size_t bufferSize;
+
+			/// Bytes of a recorder waiting to be written. Frames arriving beyond this are dropped, video resumes
+			/// with the next key frame.
+			size_t maxQueuedBytes;
+
+			/// Opens the files with O_DIRECT where the platform has it, bypassing the page cache.
+			bool directIO;
+		};
+
+		class CRTC_EXPORT RTCRecorder {
+		public:
+			virtual ~RTCRecorder() { }
+
+			/// Bytes written to the files so far.
+			virtual uint64_t BytesWritten() const = 0;
+
+			/// Frames and packets left out because the queue was full or a write failed.
+			virtual uint64_t FramesDropped() const = 0;
+
+			/// Writes what is buffered, completes the file headers and closes the files. The callback runs on the
+			/// connection's executor with the first write error, if there was one.
+			virtual void Stop(std::function<void(std::shared_ptr<Error>)> callback = nullptr) = 0;
+		};
+
 		explicit RTCPeerConnection();
 		virtual ~RTCPeerConnection();
 
 		static std::shared_ptr<RTCPeerConnection> New(const RTCConfiguration& config = RTCConfiguration());
 
+		/// Creates count connections with the same configuration. Connections prepared by the pool
+		/// (see Module::Options::peerConnectionPoolSize) are used first. Failed connections are left out.
+
+		static std::vector<std::shared_ptr<RTCPeerConnection>> NewBatch(size_t count, const RTCConfiguration& config = RTCConfiguration());
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/generateCertificate
+		///
+		/// Generated on a background thread, the callback runs on the calling executor. An expiresMs of 0 uses the WebRTC default.
+
+		static void GenerateCertificate(std::function<void(std::shared_ptr<Error>, std::shared_ptr<RTCCertificate>)> callback, RTCCertificate::KeyType keyType = RTCCertificate::kECDSA, uint64_t expiresMs = 0);
+
 		virtual std::shared_ptr<RTCDataChannel> CreateDataChannel(const String& label, const RTCDataChannelInit& options = RTCDataChannelInit()) = 0;
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/addIceCandidate
 
 		virtual void AddIceCandidate(const RTCIceCandidate& candidate) = 0;
+		virtual void AddIceCandidate(const RTCIceCandidate& candidate, std::function<void(std::shared_ptr<Error>)> callback) = 0;
+
+		/// Parses the candidates on the calling thread and applies them in one signaling thread hop.
+		/// The callback runs once on the connection's executor with the first error, if any.
+
+		virtual void AddIceCandidates(const std::vector<RTCIceCandidate>& candidates, std::function<void(std::shared_ptr<Error>)> callback = nullptr) = 0;
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/addStream
 
 		virtual void AddStream(const std::shared_ptr<MediaStream>& stream) = 0;
 
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/addTrack
+		///
+		/// sendEncodings publishes simulcast layers, as with RTCRtpTransceiverInit. nullptr for data-only connections and on failure.
+
+		virtual std::shared_ptr<RTCRtpSender> AddTrack(const std::shared_ptr<MediaStreamTrack>& track, const MediaStreams& streams = MediaStreams(),
+			const std::vector<RTCRtpEncodingParameters>& sendEncodings = std::vector<RTCRtpEncodingParameters>()) = 0;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/removeTrack
+
+		virtual bool RemoveTrack(const std::shared_ptr<RTCRtpSender>& sender) = 0;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/getSenders
+
+		virtual std::vector<std::shared_ptr<RTCRtpSender>> GetSenders() = 0;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/addTransceiver
+		///
+		/// Adds one media section to the following offers. nullptr for data-only connections and on failure.
+
+		virtual std::shared_ptr<RTCRtpTransceiver> AddTransceiver(MediaStreamTrack::Type kind, const RTCRtpTransceiverInit& init = RTCRtpTransceiverInit()) = 0;
+		virtual std::shared_ptr<RTCRtpTransceiver> AddTransceiver(const std::shared_ptr<MediaStreamTrack>& track, const RTCRtpTransceiverInit& init = RTCRtpTransceiverInit()) = 0;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/getTransceivers
+
+		virtual std::vector<std::shared_ptr<RTCRtpTransceiver>> GetTransceivers() = 0;
+
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/createAnswer
 
 		virtual void CreateAnswer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options = RTCAnswerOptions()) = 0;
+		virtual void CreateAnswer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options = RTCAnswerOptions()) = 0;
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/createOffer
 
 		virtual void CreateOffer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options = RTCOfferOptions()) = 0;
+		virtual void CreateOffer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options = RTCOfferOptions()) = 0;
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/getLocalStreams
 
@@ -811,14 +1435,135 @@ namespace crtc {
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/setLocalDescription
 
 		virtual void SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp) = 0;
+		virtual void SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) = 0;
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/setRemoteDescription
 
 		virtual void SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp) = 0;
+		virtual void SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) = 0;
+
+#ifdef CRTC_COROUTINES
+		// CreateOffer, CreateAnswer, SetLocalDescription and SetRemoteDescription are queued per connection
+		// and completed in call order. The awaiters resume the coroutine on the connection's executor.
+
+		struct RTCSessionDescriptionResult {
+			std::shared_ptr<Error> error;
+			RTCSessionDescription description;
+		};
+
+		class CreateDescriptionAwaiter {
+		public:
+			CreateDescriptionAwaiter(RTCPeerConnection* pc, const RTCOfferOptions& options) : _pc(pc), _offer(true), _offerOptions(options), _answerOptions() { }
+			CreateDescriptionAwaiter(RTCPeerConnection* pc, const RTCAnswerOptions& options) : _pc(pc), _offer(false), _offerOptions(), _answerOptions(options) { }
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				CreateDescriptionAwaiter* self = this;
+				_handle = handle;
+
+				// Capturing a single pointer keeps std::function from allocating.
+				std::function<void(std::shared_ptr<Error>, RTCSessionDescription*)> callback([self](std::shared_ptr<Error> error, RTCSessionDescription* sdp) {
+					self->_result.error = std::move(error);
+
+					if (sdp) {
+						self->_result.description = *sdp;
+					}
+
+					self->_handle.resume();
+				});
+
+				if (_offer) {
+					_pc->CreateOffer(std::move(callback), _offerOptions);
+				}
+				else {
+					_pc->CreateAnswer(std::move(callback), _answerOptions);
+				}
+			}
+
+			RTCSessionDescriptionResult await_resume() {
+				return std::move(_result);
+			}
+
+		private:
+			RTCPeerConnection* _pc;
+			bool _offer;
+			RTCOfferOptions _offerOptions;
+			RTCAnswerOptions _answerOptions;
+			std::coroutine_handle<> _handle;
+			RTCSessionDescriptionResult _result;
+		};
+
+		class SetDescriptionAwaiter {
+		public:
+			SetDescriptionAwaiter(RTCPeerConnection* pc, std::shared_ptr<const RTCSessionDescription> sdp, bool local) : _pc(pc), _sdp(std::move(sdp)), _local(local) { }
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				SetDescriptionAwaiter* self = this;
+				_handle = handle;
+
+				std::function<void(std::shared_ptr<Error>)> callback([self](std::shared_ptr<Error> error) {
+					self->_error = std::move(error);
+					self->_handle.resume();
+				});
+
+				if (_local) {
+					_pc->SetLocalDescription(std::move(_sdp), std::move(callback));
+				}
+				else {
+					_pc->SetRemoteDescription(std::move(_sdp), std::move(callback));
+				}
+			}
+
+			std::shared_ptr<Error> await_resume() {
+				return std::move(_error);
+			}
+
+		private:
+			RTCPeerConnection* _pc;
+			std::shared_ptr<const RTCSessionDescription> _sdp;
+			bool _local;
+			std::coroutine_handle<> _handle;
+			std::shared_ptr<Error> _error;
+		};
+
+		CreateDescriptionAwaiter CreateOfferAsync(const RTCOfferOptions& options = RTCOfferOptions()) {
+			return CreateDescriptionAwaiter(this, options);
+		}
+
+		CreateDescriptionAwaiter CreateAnswerAsync(const RTCAnswerOptions& options = RTCAnswerOptions()) {
+			return CreateDescriptionAwaiter(this, options);
+		}
+
+		SetDescriptionAwaiter SetLocalDescriptionAsync(std::shared_ptr<const RTCSessionDescription> sdp) {
+			return SetDescriptionAwaiter(this, std::move(sdp), true);
+		}
+
+		SetDescriptionAwaiter SetRemoteDescriptionAsync(std::shared_ptr<const RTCSessionDescription> sdp) {
+			return SetDescriptionAwaiter(this, std::move(sdp), false);
+		}
+#endif
 
 		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/close
+		///
+		/// The callback variant closes on the signaling thread and runs the callback once every pending
+		/// offer/answer operation has settled. Threads and sockets are released in the background when the
+		/// last reference to the connection is dropped.
 
 		virtual void Close() = 0;
+		virtual void Close(std::function<void()> callback) = 0;
+
+		/// \sa https://developer.mozilla.org/en-US/docs/Web/API/RTCPeerConnection/getStats
+		///
+		/// The report is collected and flattened on the signaling thread, the callback runs on the connection's executor.
+
+		virtual void GetStats(std::function<void(std::shared_ptr<Error>, const RTCStatsReport&)> callback, const RTCStatsOptions& options = RTCStatsOptions()) = 0;
 
 		virtual RTCSessionDescription CurrentLocalDescription() = 0;
 		virtual RTCSessionDescription CurrentRemoteDescription() = 0;
@@ -831,9 +1576,28 @@ namespace crtc {
 		virtual RTCIceGatheringState IceGatheringState() = 0;
 		virtual RTCSignalingState SignalingState() = 0;
 
+		/// True while onRawVideo(), a video relay or a recorder takes the encoded video, and onRawAudio() or a
+		/// recorder the encoded audio. Decoders check it for every frame.
+
 		virtual bool BypassVideoDecoder() = 0;
 		virtual bool BypassAudioDecoder() = 0;
 
+		/// Forwards the video this connection receives to other connections without decoding or encoding it.
+		/// Add the returned track to them with AddTrack(), their senders packetize the frames as they arrive.
+		/// Key frames they request are asked from the remote peer, at most once per
+		/// Module::Options::broadcastKeyFrameIntervalMs, and frames are restamped on each sender's clock.
+		/// Senders only forward the codec received here and prefer it when it is known by the time they are added.
+		/// Returns the same track on every call, nullptr for dataChannelsOnly connections.
+
+		virtual std::shared_ptr<MediaStreamTrack> CreateVideoRelay() = 0;
+
+		/// Records the media this connection receives without decoding it. Frames are muxed on the threads receiving
+		/// them and written by one background thread shared by every recorder, so slow disks never block them.
+		/// A new recording stops the previous one, closing the connection stops it. Returns nullptr when neither
+		/// path is set, when a file can't be created and for dataChannelsOnly connections.
+
+		virtual std::shared_ptr<RTCRecorder> Record(const RTCRecorderOptions& options) = 0;
+
 		virtual void onRawVideo(std::function<void(const unsigned char* data, size_t length, bool isKeyFrame, int64_t renderTimeMs)> callback) = 0;
 		virtual void onRawAudio(std::function<void(const unsigned char* data, size_t length)> callback) = 0;
 		virtual void onAddTrack(std::function<void(const std::shared_ptr<MediaStreamTrack>)> callback) = 0;
@@ -27,6 +27,7 @@
 #define CRTC_AUDIODEVICE_H
 
 #include "crtc.h"
+#include "metrics.h"
 #include "modules/audio_device/include/fake_audio_device.h"
 #include <rtc_base/synchronization/mutex.h>
 #include <rtc_base/thread.h>
@@ -45,6 +46,7 @@ namespace crtc {
 
 		~AudioDevice() override {
 			StopRecording();
+			MetricsRegistry::Add(MetricsRegistry::kAudioQueueDepth, -static_cast<int64_t>(_queue.size()));
 		}
 
 		sigslot::signal0<> Drain;
@@ -54,6 +56,7 @@ namespace crtc {
 
 			if (Recording()) {
 				_queue.push_back(Queue(buffer, callback));
+				MetricsRegistry::Add(MetricsRegistry::kAudioQueueDepth);
 			}
 			else {
 				if(callback)
@@ -125,6 +128,7 @@ namespace crtc {
 					if (!_queue.empty()) {
 						pending = _queue.front();
 						_queue.pop_front();
+						MetricsRegistry::Add(MetricsRegistry::kAudioQueueDepth, -1);
 					}
 					else {
 						if (_drainNeeded) {
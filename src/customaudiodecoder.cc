@@ -18,10 +18,33 @@ namespace crtc {
 
 	void CustomAudioDecoder::Reset()
 	{
+		_decoder->Reset();
 	}
 
     std::vector<webrtc::AudioDecoder::ParseResult> CustomAudioDecoder::ParsePayload(rtc::Buffer&& payload, uint32_t timestamp)
     {
+        bool decode = false;
+        bool passthrough = false;
+
+        _pc->AudioDecodeMode(&decode, &passthrough);
+
+        if (passthrough) {
+            _pc->RecordAudio(payload.data(), payload.size(), timestamp, Channels());
+        }
+
+        // Opus packets decode on their own, switching needs no resync.
+        if (decode) {
+            if (passthrough) {
+                _pc->onRawAudio(payload.data(), payload.size());
+            }
+
+            return _decoder->ParsePayload(std::move(payload), timestamp);
+        }
+
+        if (!passthrough) {
+            return {};
+        }
+
         if (_decoder->PacketHasFec(payload.data(), payload.size())) {
             return _decoder->ParsePayload(std::move(payload), timestamp);
         }
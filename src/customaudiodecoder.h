@@ -7,6 +7,8 @@
 
 namespace crtc {
 	class RTCPeerConnectionInternal;
+
+	// Passes the packets through, decodes them or both, as the audio tracks of the connection ask for every packet.
 	class CustomAudioDecoder : public webrtc::AudioDecoder {
 	public:
 		CustomAudioDecoder(RTCPeerConnectionInternal* pc, rtc::scoped_refptr<webrtc::AudioDecoderFactory> audioFactory,
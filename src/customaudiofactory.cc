@@ -48,9 +48,9 @@ namespace crtc {
 	std::unique_ptr<webrtc::AudioDecoder> CustomAudioFactory::MakeAudioDecoder(const webrtc::SdpAudioFormat& format,
 		absl::optional<webrtc::AudioCodecPairId> codec_pair_id)
 	{
-		if (_pc->BypassAudioDecoder())
-			return std::make_unique<CustomAudioDecoder>(_pc, _audioFactory, format, codec_pair_id);
+		if (!_audioFactory->IsSupportedDecoder(format))
+			return nullptr;
 
-		return _audioFactory->MakeAudioDecoder(format, codec_pair_id);
+		return std::make_unique<CustomAudioDecoder>(_pc, _audioFactory, format, codec_pair_id);
 	}
 }
@@ -1,9 +1,14 @@
 #include "customvideodecoder.h"
+#include "customvideoencoderfactory.h"
 #include "rtcpeerconnection.h"
+#include "trace.h"
+#include "modules/video_coding/include/video_error_codes.h"
+#include "rtc_base/time_utils.h"
 
 namespace crtc {
-	CustomVideoDecoder::CustomVideoDecoder(RTCPeerConnectionInternal* pc) :
-		_decoderInfo(), _pc(pc)
+	CustomVideoDecoder::CustomVideoDecoder(RTCPeerConnectionInternal* pc, std::unique_ptr<webrtc::VideoDecoder> decoder) :
+		_decoderInfo(), _pc(pc), _codec(webrtc::kVideoCodecGeneric),
+		_decoder(std::move(decoder)), _callback(nullptr), _configured(false), _waiting_for_key_frame(true), _last_request_ms(-1)
 	{
 		_decoderInfo.implementation_name = "Custom Decoder";
 		_decoderInfo.is_hardware_accelerated = true;
@@ -11,38 +16,115 @@ namespace crtc {
 
 	CustomVideoDecoder::~CustomVideoDecoder()
 	{
-
+		Release();
 	}
 
 	bool CustomVideoDecoder::Configure(const Settings& settings)
 	{
+		Release();
+
+		_settings = settings;
+		_codec = settings.codec_type();
+		_pc->RelayVideoCodec(_codec);
 		return true;
 	}
 	int32_t CustomVideoDecoder::RegisterDecodeCompleteCallback(webrtc::DecodedImageCallback* callback)
 	{
+		_callback = callback;
+
+		if (_decoder) {
+			_decoder->RegisterDecodeCompleteCallback(callback);
+		}
+
 		return 0;
 	}
 
 	int32_t CustomVideoDecoder::Release()
 	{
+		if (_configured) {
+			_decoder->Release();
+			_configured = false;
+		}
+
 		return 0;
 	}
 
 	int32_t CustomVideoDecoder::Decode(const webrtc::EncodedImage& input_image, int64_t render_time_ms)
 	{
-		_pc->onRawVideo(input_image, render_time_ms);
-		return 0;
+		CRTC_TRACE_SCOPE("media", "CustomVideoDecoder::Decode");
+		bool decode = false;
+		bool passthrough = false;
+		int32_t result = WEBRTC_VIDEO_CODEC_OK;
+
+		_pc->VideoDecodeMode(input_image, &decode, &passthrough);
+
+		if (passthrough) {
+			_pc->onRawVideo(input_image, render_time_ms);
+			_pc->RecordVideo(input_image, _codec);
+
+			// Asks the remote peer for a key frame on behalf of the connections relaying this video.
+			if (_pc->RelayVideo(input_image, _codec)) {
+				result = WEBRTC_VIDEO_CODEC_OK_REQUEST_KEYFRAME;
+			}
+		}
+
+		if (decode) {
+			int32_t decoded = DecodeFrame(input_image, render_time_ms);
+
+			if (decoded != WEBRTC_VIDEO_CODEC_OK) {
+				result = decoded;
+			}
+		}
+		else {
+			Release();
+		}
+
+		return result;
 	}
 
 	int32_t CustomVideoDecoder::Decode(const webrtc::EncodedImage& input_image, bool missing_frames, int64_t render_time_ms)
 	{
 		(void)missing_frames;
-		_pc->onRawVideo(input_image, render_time_ms);
-		return 0;
+		return Decode(input_image, render_time_ms);
 	}
 
 	webrtc::VideoDecoder::DecoderInfo CustomVideoDecoder::GetDecoderInfo() const
 	{
-		return _decoderInfo;
+		return _configured ? _decoder->GetDecoderInfo() : _decoderInfo;
+	}
+
+	int32_t CustomVideoDecoder::DecodeFrame(const webrtc::EncodedImage& input_image, int64_t render_time_ms)
+	{
+		if (!_decoder || !_settings) {
+			return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+		}
+
+		if (!_configured) {
+			if (!_decoder->Configure(*_settings)) {
+				return WEBRTC_VIDEO_CODEC_ERROR;
+			}
+
+			_decoder->RegisterDecodeCompleteCallback(_callback);
+			_configured = true;
+			_waiting_for_key_frame = true;
+		}
+
+		// Frames skipped while only passing through left the codec without references.
+		if (_waiting_for_key_frame) {
+			if (input_image._frameType != webrtc::VideoFrameType::kVideoFrameKey) {
+				int64_t now = rtc::TimeMillis();
+
+				if (_last_request_ms < 0 || now - _last_request_ms >= CustomVideoEncoderFactory::KeyFrameIntervalMs()) {
+					_last_request_ms = now;
+					return WEBRTC_VIDEO_CODEC_OK_REQUEST_KEYFRAME;
+				}
+
+				return WEBRTC_VIDEO_CODEC_OK;
+			}
+
+			_waiting_for_key_frame = false;
+		}
+
+		return _decoder->Decode(input_image, render_time_ms);
 	}
-}
\ No newline at end of file
+}
@@ -2,12 +2,16 @@
 #define CRTC_CUSTOMVIDEODECODER_H
 
 #include "api/video_codecs/video_decoder.h"
+#include "absl/types/optional.h"
+#include <memory>
 
 namespace crtc {
 	class RTCPeerConnectionInternal;
+	// Passes the frames through, decodes them or both, as the track receiving them asks for every frame. The codec
+	// is configured when decoding starts, released when it stops and resumes at a key frame.
 	class CustomVideoDecoder : public webrtc::VideoDecoder {
 	public:
-		CustomVideoDecoder(RTCPeerConnectionInternal* pc);
+		CustomVideoDecoder(RTCPeerConnectionInternal* pc, std::unique_ptr<webrtc::VideoDecoder> decoder);
 		virtual ~CustomVideoDecoder();
 
 		bool Configure(const Settings& settings) override;
@@ -19,8 +23,18 @@ namespace crtc {
 		virtual webrtc::VideoDecoder::DecoderInfo GetDecoderInfo() const override;
 
 	private:
+		int32_t DecodeFrame(const webrtc::EncodedImage& input_image, int64_t render_time_ms);
+
 		DecoderInfo _decoderInfo;
 		RTCPeerConnectionInternal* _pc;
+		webrtc::VideoCodecType _codec;
+
+		std::unique_ptr<webrtc::VideoDecoder> _decoder;
+		webrtc::DecodedImageCallback* _callback;
+		absl::optional<Settings> _settings;
+		bool _configured;
+		bool _waiting_for_key_frame;
+		int64_t _last_request_ms;
 	};
 
 }
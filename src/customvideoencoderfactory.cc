@@ -0,0 +1,221 @@
+#include "customvideoencoderfactory.h"
+#include "sharedvideoencoder.h"
+#include "videorelay.h"
+#include "absl/strings/match.h"
+#include "api/video_codecs/video_encoder.h"
+#include "api/video_codecs/video_encoder_factory_template.h"
+#include "api/video_codecs/video_encoder_factory_template_libaom_av1_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp8_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp9_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_open_h264_adapter.h"
+#include <mutex>
+
+using namespace crtc;
+
+namespace {
+	std::mutex settingsMutex;
+	std::vector<Module::VideoEncoderSettings> configured = {
+		Module::VideoEncoderSettings(Module::kH264),
+		Module::VideoEncoderSettings(Module::kVP8),
+		Module::VideoEncoderSettings(Module::kVP9),
+		Module::VideoEncoderSettings(Module::kAV1),
+	};
+	int keyFrameIntervalMs = 500;
+
+	const char* CodecName(Module::VideoCodec codec) {
+		switch (codec) {
+			case Module::kVP8:
+				return "VP8";
+			case Module::kVP9:
+				return "VP9";
+			case Module::kAV1:
+				return "AV1";
+			default:
+				return "H264";
+		}
+	}
+
+	webrtc::VideoCodecComplexity Complexity(Module::VideoEncoderSpeed speed) {
+		switch (speed) {
+			case Module::kSpeedFastest:
+				return webrtc::VideoCodecComplexity::kComplexityLow;
+			case Module::kSpeedSlower:
+				return webrtc::VideoCodecComplexity::kComplexityHigh;
+			case Module::kSpeedSlowest:
+				return webrtc::VideoCodecComplexity::kComplexityMax;
+			default:
+				return webrtc::VideoCodecComplexity::kComplexityNormal;
+		}
+	}
+
+	// Forwards everything to the codec, overriding the complexity and core count it is initialized with.
+	class ConfiguredVideoEncoder : public webrtc::VideoEncoder {
+	public:
+		ConfiguredVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder, const Module::VideoEncoderSettings& settings) :
+			_encoder(std::move(encoder)),
+			_complexity(Complexity(settings.speed)),
+			_threads(settings.threads)
+		{ }
+
+		void SetFecControllerOverride(webrtc::FecControllerOverride* fec_controller_override) override {
+			_encoder->SetFecControllerOverride(fec_controller_override);
+		}
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings, const webrtc::VideoEncoder::Settings& settings) override {
+			webrtc::VideoCodec codec = *codec_settings;
+			webrtc::VideoEncoder::Settings limited = settings;
+
+			codec.SetVideoEncoderComplexity(_complexity);
+
+			// Every codec sizes its thread count from number_of_cores and the resolution.
+			if (_threads > 0 && _threads < limited.number_of_cores) {
+				limited.number_of_cores = _threads;
+			}
+
+			return _encoder->InitEncode(&codec, limited);
+		}
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override {
+			return _encoder->RegisterEncodeCompleteCallback(callback);
+		}
+
+		int32_t Release() override {
+			return _encoder->Release();
+		}
+
+		int32_t Encode(const webrtc::VideoFrame& frame, const std::vector<webrtc::VideoFrameType>* frame_types) override {
+			return _encoder->Encode(frame, frame_types);
+		}
+
+		void SetRates(const RateControlParameters& parameters) override {
+			_encoder->SetRates(parameters);
+		}
+
+		void OnPacketLossRateUpdate(float packet_loss_rate) override {
+			_encoder->OnPacketLossRateUpdate(packet_loss_rate);
+		}
+
+		void OnRttUpdate(int64_t rtt_ms) override {
+			_encoder->OnRttUpdate(rtt_ms);
+		}
+
+		void OnLossNotification(const LossNotification& loss_notification) override {
+			_encoder->OnLossNotification(loss_notification);
+		}
+
+		EncoderInfo GetEncoderInfo() const override {
+			return _encoder->GetEncoderInfo();
+		}
+
+	private:
+		std::unique_ptr<webrtc::VideoEncoder> _encoder;
+		webrtc::VideoCodecComplexity _complexity;
+		int _threads;
+	};
+}
+
+void CustomVideoEncoderFactory::Configure(const std::vector<Module::VideoEncoderSettings>& settings, int broadcastKeyFrameIntervalMs) {
+	std::lock_guard<std::mutex> lock(settingsMutex);
+	configured = settings;
+	keyFrameIntervalMs = broadcastKeyFrameIntervalMs;
+}
+
+int CustomVideoEncoderFactory::KeyFrameIntervalMs() {
+	std::lock_guard<std::mutex> lock(settingsMutex);
+	return keyFrameIntervalMs;
+}
+
+CustomVideoEncoderFactory::CustomVideoEncoderFactory() :
+	_factory(std::make_unique<webrtc::VideoEncoderFactoryTemplate<
+		webrtc::OpenH264EncoderTemplateAdapter,
+		webrtc::LibvpxVp8EncoderTemplateAdapter,
+		webrtc::LibvpxVp9EncoderTemplateAdapter,
+		webrtc::LibaomAv1EncoderTemplateAdapter>>())
+{
+	std::lock_guard<std::mutex> lock(settingsMutex);
+	_settings = configured;
+	_key_frame_interval_ms = keyFrameIntervalMs;
+}
+
+CustomVideoEncoderFactory::~CustomVideoEncoderFactory() {
+
+}
+
+void CustomVideoEncoderFactory::SetBroadcastGroup(const std::string& group) {
+	_group = group;
+}
+
+std::vector<webrtc::SdpVideoFormat> CustomVideoEncoderFactory::GetSupportedFormats() const {
+	std::vector<webrtc::SdpVideoFormat> supported = _factory->GetSupportedFormats();
+	std::vector<webrtc::SdpVideoFormat> formats;
+
+	for (size_t index = 0; index < _settings.size(); index++) {
+		const char* name = CodecName(_settings[index].codec);
+
+		// Listed twice, the first entry decides.
+		if (Find(name) != &_settings[index]) {
+			continue;
+		}
+
+		for (const auto& format : supported) {
+			if (absl::EqualsIgnoreCase(format.name, name)) {
+				formats.push_back(format);
+			}
+		}
+	}
+
+	return formats;
+}
+
+webrtc::VideoEncoderFactory::CodecSupport CustomVideoEncoderFactory::QueryCodecSupport(const webrtc::SdpVideoFormat& format, absl::optional<std::string> scalability_mode) const {
+	if (!Find(format.name)) {
+		return CodecSupport();
+	}
+
+	return _factory->QueryCodecSupport(format, std::move(scalability_mode));
+}
+
+std::unique_ptr<webrtc::VideoEncoder> CustomVideoEncoderFactory::Create(const webrtc::Environment& env, const webrtc::SdpVideoFormat& format) {
+	const Module::VideoEncoderSettings* settings = Find(format.name);
+
+	if (!settings) {
+		return nullptr;
+	}
+
+	std::unique_ptr<webrtc::VideoEncoder> encoder;
+
+	if (!_group.empty()) {
+		webrtc::VideoEncoderFactory* factory = _factory.get();
+		Module::VideoEncoderSettings configuration = *settings;
+
+		// The factory outlives the encoders it creates, the connection's factory owns it.
+		auto create = [factory, env, format, configuration]() -> std::unique_ptr<webrtc::VideoEncoder> {
+			auto encoder = factory->Create(env, format);
+			return encoder ? std::make_unique<ConfiguredVideoEncoder>(std::move(encoder), configuration) : nullptr;
+		};
+
+		encoder = std::make_unique<SharedVideoEncoder>(_group + "/" + format.ToString(), std::move(create), _key_frame_interval_ms);
+	}
+	else {
+		auto codec = _factory->Create(env, format);
+
+		if (!codec) {
+			return nullptr;
+		}
+
+		encoder = std::make_unique<ConfiguredVideoEncoder>(std::move(codec), *settings);
+	}
+
+	// Frames of relay tracks bypass the codec.
+	return std::make_unique<RelayVideoEncoder>(std::move(encoder));
+}
+
+const Module::VideoEncoderSettings* CustomVideoEncoderFactory::Find(const std::string& name) const {
+	for (const auto& settings : _settings) {
+		if (absl::EqualsIgnoreCase(name, CodecName(settings.codec))) {
+			return &settings;
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,40 @@
+#ifndef CRTC_CUSTOMVIDEOENCODERFACTORY_H
+#define CRTC_CUSTOMVIDEOENCODERFACTORY_H
+
+#include "crtc.h"
+#include "api/environment/environment.h"
+#include "api/video_codecs/video_encoder_factory.h"
+
+namespace crtc {
+	// Offers the encoders chosen with Module::Options::videoEncoders in their order of preference and
+	// applies each codec's speed and thread limit when an encoder is initialized. VP8 and H264 encode
+	// simulcast layers themselves, VP9 and AV1 add spatial and temporal layers through scalabilityMode.
+	// Factories given a broadcast group share their encoders with the group, see SharedVideoEncoder.
+	class CustomVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+	public:
+		// Used by factories created afterwards, existing connections keep their encoders.
+		static void Configure(const std::vector<Module::VideoEncoderSettings>& settings, int broadcastKeyFrameIntervalMs);
+		static int KeyFrameIntervalMs();
+
+		CustomVideoEncoderFactory();
+		~CustomVideoEncoderFactory() override;
+
+		// Applies to encoders created afterwards. Set before the connection negotiates, WebRTC creates
+		// encoders on the worker thread once video is sent.
+		void SetBroadcastGroup(const std::string& group);
+
+		std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+		CodecSupport QueryCodecSupport(const webrtc::SdpVideoFormat& format, absl::optional<std::string> scalability_mode) const override;
+		std::unique_ptr<webrtc::VideoEncoder> Create(const webrtc::Environment& env, const webrtc::SdpVideoFormat& format) override;
+
+	private:
+		const Module::VideoEncoderSettings* Find(const std::string& name) const;
+
+		std::vector<Module::VideoEncoderSettings> _settings;
+		int _key_frame_interval_ms;
+		std::string _group;
+		std::unique_ptr<webrtc::VideoEncoderFactory> _factory;
+	};
+}
+
+#endif
@@ -31,14 +31,13 @@ namespace crtc {
 
 	std::unique_ptr<webrtc::VideoDecoder> CustomVideoFactory::Create(const webrtc::Environment& env, const webrtc::SdpVideoFormat& format)
 	{
-		if (_pc->BypassVideoDecoder())
-			return std::make_unique<CustomVideoDecoder>(_pc);
-		
-		return CreateVideoDecoderInternal<
+		// Created up front but only configured once a track asks for decoded frames.
+		auto decoder = CreateVideoDecoderInternal<
 			webrtc::LibvpxVp8DecoderTemplateAdapter,
 			webrtc::LibvpxVp9DecoderTemplateAdapter,
 			webrtc::OpenH264DecoderTemplateAdapter,
 			webrtc::Dav1dDecoderTemplateAdapter>(env, format);
-		
+
+		return std::make_unique<CustomVideoDecoder>(_pc, std::move(decoder));
 	}
 }
@@ -0,0 +1,69 @@
+#include "decodeswitch.h"
+#include <iterator>
+#include <map>
+#include <mutex>
+
+using namespace crtc;
+
+namespace {
+	std::mutex switchesMutex;
+	std::map<webrtc::MediaStreamTrackInterface*, std::weak_ptr<DecodeSwitch>> switches;
+}
+
+std::shared_ptr<DecodeSwitch> DecodeSwitch::For(const rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>& track) {
+	if (!track) {
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(switchesMutex);
+	std::shared_ptr<DecodeSwitch> decodeSwitch = switches[track.get()].lock();
+
+	if (!decodeSwitch) {
+		for (auto it = switches.begin(); it != switches.end();) {
+			it = it->second.expired() ? switches.erase(it) : std::next(it);
+		}
+
+		decodeSwitch = std::make_shared<DecodeSwitch>(track);
+		switches[track.get()] = decodeSwitch;
+	}
+
+	return decodeSwitch;
+}
+
+DecodeSwitch::DecodeSwitch(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> track) :
+	_track(std::move(track)),
+	_mode(MediaStreamTrack::kDecodeAuto),
+	_consumers(0)
+{ }
+
+void DecodeSwitch::SetMode(MediaStreamTrack::DecodeMode mode) {
+	_mode.store(mode, std::memory_order_relaxed);
+}
+
+MediaStreamTrack::DecodeMode DecodeSwitch::Mode() const {
+	return static_cast<MediaStreamTrack::DecodeMode>(_mode.load(std::memory_order_relaxed));
+}
+
+void DecodeSwitch::AddConsumer() {
+	_consumers.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DecodeSwitch::RemoveConsumer() {
+	_consumers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool DecodeSwitch::Decodes(bool bypass) const {
+	switch (Mode()) {
+		case MediaStreamTrack::kDecodeOnly:
+		case MediaStreamTrack::kDecodeBoth:
+			return true;
+		case MediaStreamTrack::kDecodePassthrough:
+			return false;
+		default:
+			return !bypass || _consumers.load(std::memory_order_relaxed) > 0;
+	}
+}
+
+bool DecodeSwitch::PassesThrough(bool bypass) const {
+	return bypass && Mode() != MediaStreamTrack::kDecodeOnly;
+}
@@ -0,0 +1,35 @@
+#ifndef CRTC_DECODESWITCH_H
+#define CRTC_DECODESWITCH_H
+
+#include "crtc.h"
+#include "api/media_stream_interface.h"
+#include <atomic>
+
+namespace crtc {
+	// Decode mode of a remote track, shared by every wrapper of the track and by the connection receiving it.
+	class DecodeSwitch {
+	public:
+		static std::shared_ptr<DecodeSwitch> For(const rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>& track);
+
+		explicit DecodeSwitch(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> track);
+
+		void SetMode(MediaStreamTrack::DecodeMode mode);
+		MediaStreamTrack::DecodeMode Mode() const;
+
+		// Wrappers of the track with a frame callback set.
+		void AddConsumer();
+		void RemoveConsumer();
+
+		// bypass tells whether the connection has a passthrough consumer.
+		bool Decodes(bool bypass) const;
+		bool PassesThrough(bool bypass) const;
+
+	private:
+		// Keeps the address of the track from being reused while it is a key of the registry.
+		rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> _track;
+		std::atomic<int> _mode;
+		std::atomic<int> _consumers;
+	};
+}
+
+#endif
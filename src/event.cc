@@ -25,7 +25,6 @@
 
 #include "event.h"
 #include "module.h"
-#include <base/atomicops.h>
 
 using namespace crtc;
 
@@ -33,10 +32,10 @@ std::shared_ptr<Event> Event::New() {
   return std::make_shared<Event>();
 }
 
-Event::Event() {
-	base::subtle::NoBarrier_AtomicIncrement(&ModuleInternal::pending_events, 1);
-}
+Event::Event() :
+	_shard(ModuleInternal::pending_events.Acquire())
+{ }
 
 Event::~Event() {
-	base::subtle::NoBarrier_AtomicIncrement(&ModuleInternal::pending_events, -1);
+	ModuleInternal::pending_events.Release(_shard);
 }
@@ -13,6 +13,9 @@ namespace crtc {
 		virtual ~Event();
 
 		static std::shared_ptr<Event> New();
+
+	private:
+		uint32_t _shard;
 	};
 }
 
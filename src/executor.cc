@@ -0,0 +1,349 @@
+#include "executor.h"
+#include "module.h"
+#include "metrics.h"
+#include "trace.h"
+
+using namespace crtc;
+
+namespace {
+	thread_local ExecutorInternal* currentExecutor = nullptr;
+	thread_local size_t currentWorker = 0;
+
+	// A task can release the last reference to the executor running it. The executor can't join the thread
+	// it runs on, so it is destroyed on a short lived thread instead while the task returns.
+	void DeleteExecutor(ExecutorInternal* executor) {
+		if (executor->OwnsCurrentThread()) {
+			std::thread([executor]() { delete executor; }).detach();
+			return;
+		}
+
+		delete executor;
+	}
+}
+
+namespace crtc {
+	// Nodes are usually released on a different thread than they were acquired on, so each
+	// thread keeps a bounded cache and exchanges batches with a shared list when it runs dry or overflows.
+	class TaskCache {
+	public:
+		static const size_t kBatch = 64;
+		static const size_t kLocalLimit = 4 * kBatch;
+		static const size_t kSharedLimit = 64 * kBatch;
+
+		~TaskCache() {
+			Spill(_count);
+		}
+
+		TaskNode* Pop() {
+			if (!_head) {
+				Refill();
+			}
+
+			if (!_head) {
+				return new TaskNode();
+			}
+
+			TaskNode* node = _head;
+			_head = node->next;
+			_count--;
+			node->next = nullptr;
+			return node;
+		}
+
+		void Push(TaskNode* node) {
+			node->next = _head;
+			_head = node;
+			_count++;
+
+			if (_count > kLocalLimit) {
+				Spill(kBatch);
+			}
+		}
+
+		static TaskCache& Local() {
+			thread_local TaskCache cache;
+			return cache;
+		}
+
+	private:
+		void Refill() {
+			std::lock_guard<std::mutex> lock(shared_mutex);
+
+			while (shared_head && _count < kBatch) {
+				TaskNode* node = shared_head;
+				shared_head = node->next;
+				shared_count--;
+				node->next = _head;
+				_head = node;
+				_count++;
+			}
+		}
+
+		void Spill(size_t count) {
+			std::lock_guard<std::mutex> lock(shared_mutex);
+
+			while (_head && count--) {
+				TaskNode* node = _head;
+				_head = node->next;
+				_count--;
+
+				if (shared_count < kSharedLimit) {
+					node->next = shared_head;
+					shared_head = node;
+					shared_count++;
+				}
+				else {
+					delete node;
+				}
+			}
+		}
+
+		TaskNode* _head = nullptr;
+		size_t _count = 0;
+
+		static std::mutex shared_mutex;
+		static TaskNode* shared_head;
+		static size_t shared_count;
+	};
+
+	std::mutex TaskCache::shared_mutex;
+	TaskNode* TaskCache::shared_head = nullptr;
+	size_t TaskCache::shared_count = 0;
+}
+
+TaskNode* TaskNode::Acquire(Task task, ExecutorInternal* executor) {
+	TaskNode* node = TaskCache::Local().Pop();
+
+	node->task = std::move(task);
+	node->executor = executor;
+	node->shard = ModuleInternal::pending_events.Acquire();
+	node->posted = MetricsRegistry::Now();
+
+	MetricsRegistry::Add(MetricsRegistry::kTasksPosted);
+	return node;
+}
+
+void TaskNode::Release(TaskNode* node) {
+	node->task.Reset();
+	node->executor = nullptr;
+
+	ModuleInternal::pending_events.Release(node->shard);
+	MetricsRegistry::Add(MetricsRegistry::kTasksCompleted);
+	TaskCache::Local().Push(node);
+}
+
+void TaskNode::Run() {
+	ExecutorInternal::Scope scope(executor);
+	CRTC_TRACE_SCOPE("crtc", "Task");
+	MetricsRegistry::Record(MetricsRegistry::kTaskQueueLatency, posted);
+	task();
+}
+
+ExecutorInternal* ExecutorInternal::Current() {
+	return currentExecutor;
+}
+
+ExecutorInternal::Scope::Scope(ExecutorInternal* executor) :
+	_previous(currentExecutor)
+{
+	currentExecutor = executor;
+}
+
+ExecutorInternal::Scope::~Scope() {
+	currentExecutor = _previous;
+}
+
+LoopExecutor::LoopExecutor(rtc::Thread* thread) :
+	_thread(thread)
+{ }
+
+LoopExecutor::LoopExecutor(std::unique_ptr<rtc::Thread> thread) :
+	_owned(std::move(thread)),
+	_thread(_owned.get())
+{ }
+
+LoopExecutor::~LoopExecutor() {
+	if (_owned) {
+		_owned->Stop();
+	}
+}
+
+std::shared_ptr<LoopExecutor> LoopExecutor::New(std::unique_ptr<rtc::Thread> thread) {
+	return std::shared_ptr<LoopExecutor>(new LoopExecutor(std::move(thread)), DeleteExecutor);
+}
+
+void LoopExecutor::Post(Task task, int delayMs) {
+	if (delayMs > 0) {
+		ModuleInternal::timers.Schedule(shared_from_this(), std::move(task), delayMs);
+		return;
+	}
+
+	_thread->PostTask(TaskHandle(TaskNode::Acquire(std::move(task), this)));
+}
+
+bool LoopExecutor::IsCurrent() const {
+	return _thread->IsCurrent();
+}
+
+bool LoopExecutor::OwnsCurrentThread() const {
+	return _owned && _thread->IsCurrent();
+}
+
+PoolExecutor::PoolExecutor(size_t threads) :
+	_next(0),
+	_queued(0),
+	_stopping(false)
+{
+	if (!threads) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	for (size_t index = 0; index < threads; index++) {
+		_workers.emplace_back(std::make_unique<Worker>());
+	}
+
+	for (size_t index = 0; index < threads; index++) {
+		_workers[index]->thread = std::thread(&PoolExecutor::Run, this, index);
+	}
+}
+
+PoolExecutor::~PoolExecutor() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+
+	_cnd.notify_all();
+
+	for (const auto& worker : _workers) {
+		std::lock_guard<std::mutex> lock(worker->mutex);
+
+		for (auto node : worker->tasks) {
+			TaskNode::Release(node);
+		}
+
+		worker->tasks.clear();
+	}
+
+	for (const auto& worker : _workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+}
+
+std::shared_ptr<PoolExecutor> PoolExecutor::New(size_t threads) {
+	return std::shared_ptr<PoolExecutor>(new PoolExecutor(threads), DeleteExecutor);
+}
+
+void PoolExecutor::Post(Task task, int delayMs) {
+	if (delayMs > 0) {
+		ModuleInternal::timers.Schedule(shared_from_this(), std::move(task), delayMs);
+		return;
+	}
+
+	TaskNode* node = TaskNode::Acquire(std::move(task), this);
+	size_t index = (currentExecutor == this) ? currentWorker : (_next.fetch_add(1, std::memory_order_relaxed) % _workers.size());
+
+	{
+		std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+		_workers[index]->tasks.push_back(node);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queued.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	_cnd.notify_one();
+}
+
+bool PoolExecutor::IsCurrent() const {
+	return currentExecutor == this;
+}
+
+bool PoolExecutor::OwnsCurrentThread() const {
+	return currentExecutor == this;
+}
+
+TaskNode* PoolExecutor::Pop(size_t index) {
+	{
+		Worker* worker = _workers[index].get();
+		std::lock_guard<std::mutex> lock(worker->mutex);
+
+		if (!worker->tasks.empty()) {
+			TaskNode* node = worker->tasks.front();
+			worker->tasks.pop_front();
+			return node;
+		}
+	}
+
+	for (size_t offset = 1; offset < _workers.size(); offset++) {
+		Worker* victim = _workers[(index + offset) % _workers.size()].get();
+		std::lock_guard<std::mutex> lock(victim->mutex);
+
+		if (!victim->tasks.empty()) {
+			TaskNode* node = victim->tasks.back();
+			victim->tasks.pop_back();
+			return node;
+		}
+	}
+
+	return nullptr;
+}
+
+void PoolExecutor::Run(size_t index) {
+	Scope scope(this);
+	currentWorker = index;
+
+	for (;;) {
+		TaskNode* node = Pop(index);
+
+		if (node) {
+			_queued.fetch_sub(1, std::memory_order_relaxed);
+			TaskHandle handle(node);
+			handle();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cnd.wait(lock, [this] { return _stopping || _queued.load(std::memory_order_relaxed) > 0; });
+
+		if (_stopping) {
+			return;
+		}
+	}
+}
+
+std::shared_ptr<Executor> Executor::Main() {
+	return ModuleInternal::main_executor;
+}
+
+std::shared_ptr<Executor> Executor::Default() {
+	return ModuleInternal::DefaultExecutor();
+}
+
+std::shared_ptr<Executor> Executor::Current() {
+	auto executor = ExecutorInternal::Current();
+
+	if (executor) {
+		return executor->shared_from_this();
+	}
+
+	return Executor::Default();
+}
+
+std::shared_ptr<Executor> Executor::NewLoop(const String& name) {
+	auto thread = rtc::Thread::Create();
+	thread->SetName(std::string(name), nullptr);
+
+	if (!thread->Start()) {
+		return nullptr;
+	}
+
+	return LoopExecutor::New(std::move(thread));
+}
+
+std::shared_ptr<Executor> Executor::NewPool(size_t threads) {
+	return PoolExecutor::New(threads);
+}
@@ -0,0 +1,121 @@
+#ifndef CRTC_EXECUTOR_H
+#define CRTC_EXECUTOR_H
+
+#include "crtc.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <rtc_base/thread.h>
+
+namespace crtc {
+	class ExecutorInternal;
+
+	// Queue entry of a posted task. Nodes are recycled through a per-thread freelist and
+	// keep the module loop alive (see ModuleInternal::pending_events) until released.
+	class TaskNode {
+		TaskNode(const TaskNode&) = delete;
+		TaskNode& operator=(const TaskNode&) = delete;
+
+	public:
+		static TaskNode* Acquire(Task task, ExecutorInternal* executor);
+		static void Release(TaskNode* node);
+
+		void Run();
+
+		Task task;
+		ExecutorInternal* executor;
+		TaskNode* next;
+		uint32_t shard;
+		int64_t posted;
+
+	private:
+		explicit TaskNode() : executor(nullptr), next(nullptr), shard(0), posted(0) { }
+		friend class TaskCache;
+	};
+
+	// Owning handle small enough to be stored inline by absl::AnyInvocable.
+	class TaskHandle {
+	public:
+		explicit TaskHandle(TaskNode* node) : _node(node) { }
+		TaskHandle(TaskHandle&& other) noexcept : _node(std::exchange(other._node, nullptr)) { }
+		TaskHandle(const TaskHandle&) = delete;
+		~TaskHandle() { if (_node) TaskNode::Release(_node); }
+
+		void operator()() { _node->Run(); }
+
+	private:
+		TaskNode* _node;
+	};
+
+	class ExecutorInternal : public Executor, public std::enable_shared_from_this<ExecutorInternal> {
+	public:
+		// Executor running the task on the calling thread, nullptr outside of executors.
+		static ExecutorInternal* Current();
+
+		// True on the threads the executor joins when it is destroyed.
+		virtual bool OwnsCurrentThread() const = 0;
+
+		class Scope {
+		public:
+			explicit Scope(ExecutorInternal* executor);
+			~Scope();
+
+		private:
+			ExecutorInternal* _previous;
+		};
+	};
+
+	// Executor backed by a single rtc::Thread, either the module loop or a dedicated thread.
+	class LoopExecutor : public ExecutorInternal {
+	public:
+		explicit LoopExecutor(rtc::Thread* thread);
+		explicit LoopExecutor(std::unique_ptr<rtc::Thread> thread);
+		~LoopExecutor() override;
+
+		// Shared executor owning the thread, safe to release from a task running on it.
+		static std::shared_ptr<LoopExecutor> New(std::unique_ptr<rtc::Thread> thread);
+
+		void Post(Task task, int delayMs = 0) override;
+		bool IsCurrent() const override;
+		bool OwnsCurrentThread() const override;
+
+	private:
+		std::unique_ptr<rtc::Thread> _owned;
+		rtc::Thread* _thread;
+	};
+
+	// Fixed set of threads with one queue each. Idle threads steal from the back of other queues.
+	class PoolExecutor : public ExecutorInternal {
+	public:
+		explicit PoolExecutor(size_t threads);
+		~PoolExecutor() override;
+
+		// Shared executor, safe to release from a task running on the pool.
+		static std::shared_ptr<PoolExecutor> New(size_t threads);
+
+		void Post(Task task, int delayMs = 0) override;
+		bool IsCurrent() const override;
+		bool OwnsCurrentThread() const override;
+
+	private:
+		struct Worker {
+			std::mutex mutex;
+			std::deque<TaskNode*> tasks;
+			std::thread thread;
+		};
+
+		void Run(size_t index);
+		TaskNode* Pop(size_t index);
+
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::atomic<size_t> _next;
+		std::atomic<intptr_t> _queued;
+		std::mutex _mutex;
+		std::condition_variable _cnd;
+		bool _stopping;
+	};
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include "logsink.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+using namespace crtc;
+
+namespace {
+	std::mutex sinkMutex;
+	std::unique_ptr<AsyncLogSink> sink;
+
+	rtc::LoggingSeverity ToLoggingSeverity(Module::LogSeverity severity) {
+		switch (severity) {
+			case Module::kLogVerbose:
+				return rtc::LS_VERBOSE;
+			case Module::kLogInfo:
+				return rtc::LS_INFO;
+			case Module::kLogWarning:
+				return rtc::LS_WARNING;
+			case Module::kLogError:
+				return rtc::LS_ERROR;
+			default:
+				return rtc::LS_NONE;
+		}
+	}
+
+	Module::LogSeverity ToLogSeverity(rtc::LoggingSeverity severity) {
+		switch (severity) {
+			case rtc::LS_VERBOSE:
+				return Module::kLogVerbose;
+			case rtc::LS_INFO:
+				return Module::kLogInfo;
+			case rtc::LS_WARNING:
+				return Module::kLogWarning;
+			default:
+				return Module::kLogError;
+		}
+	}
+
+	const char* Tag(Module::LogSeverity severity) {
+		switch (severity) {
+			case Module::kLogVerbose:
+				return "V";
+			case Module::kLogInfo:
+				return "I";
+			case Module::kLogWarning:
+				return "W";
+			default:
+				return "E";
+		}
+	}
+
+	int64_t Seconds() {
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+void AsyncLogSink::Start(Module::LogSeverity severity, std::function<void(Module::LogSeverity, const char*, size_t)> callback, uint32_t rateLimit) {
+	std::lock_guard<std::mutex> lock(sinkMutex);
+
+	// WebRTC skips formatting below the least severe level of any output, so the debug output is turned off completely.
+	rtc::LogMessage::LogToDebug(rtc::LS_NONE);
+
+	if (sink) {
+		rtc::LogMessage::RemoveLogToStream(sink.get());
+		sink.reset();
+	}
+
+	if (severity == Module::kLogNone) {
+		return;
+	}
+
+	sink.reset(new AsyncLogSink(std::move(callback), rateLimit));
+	rtc::LogMessage::AddLogToStream(sink.get(), ToLoggingSeverity(severity));
+}
+
+void AsyncLogSink::Stop() {
+	std::lock_guard<std::mutex> lock(sinkMutex);
+
+	if (sink) {
+		rtc::LogMessage::RemoveLogToStream(sink.get());
+		sink.reset();
+	}
+}
+
+AsyncLogSink::AsyncLogSink(std::function<void(Module::LogSeverity, const char*, size_t)>&& callback, uint32_t rateLimit) :
+	_callback(std::move(callback)),
+	_rate_limit(rateLimit),
+	_slots(new Slot[kSlots]),
+	_sites(new CallSite[kCallSites]),
+	_enqueue(0),
+	_waiting(false),
+	_stopping(false)
+{
+	for (size_t index = 0; index < kSlots; index++) {
+		_slots[index].sequence.store(index, std::memory_order_relaxed);
+	}
+
+	for (size_t index = 0; index < kCallSites; index++) {
+		_sites[index].window.store(0, std::memory_order_relaxed);
+		_sites[index].count.store(0, std::memory_order_relaxed);
+		_sites[index].suppressed.store(0, std::memory_order_relaxed);
+	}
+
+	_thread = std::thread(&AsyncLogSink::Run, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping.store(true, std::memory_order_release);
+	}
+
+	_cnd.notify_one();
+	_thread.join();
+}
+
+void AsyncLogSink::OnLogMessage(const std::string& message) {
+	Push(Module::kLogInfo, nullptr, 0, message.data(), message.size(), 0);
+}
+
+void AsyncLogSink::OnLogMessage(const std::string& message, rtc::LoggingSeverity severity) {
+	Push(ToLogSeverity(severity), nullptr, 0, message.data(), message.size(), 0);
+}
+
+void AsyncLogSink::OnLogMessage(const rtc::LogLineRef& line) {
+	const char* file = line.filename().data();
+	int64_t suppressed = Admit(file, line.line());
+
+	if (suppressed >= 0) {
+		Push(ToLogSeverity(line.severity()), file, line.line(), line.message().data(), line.message().size(), suppressed);
+	}
+}
+
+int64_t AsyncLogSink::Admit(const char* file, int line) {
+	if (!_rate_limit || !file) {
+		return 0;
+	}
+
+	// __FILE__ literals are unique per translation unit, so the pointer and line identify the call site.
+	uintptr_t key = reinterpret_cast<uintptr_t>(file) ^ (static_cast<uintptr_t>(line) << 1) ^ 1;
+	CallSite& site = _sites[(key * 0x9E3779B97F4A7C15ull >> 32) % kCallSites];
+	int64_t now = Seconds();
+
+	// Call sites sharing an entry are limited together, which only makes the limit stricter.
+	int64_t window = site.window.load(std::memory_order_relaxed);
+
+	if (window != now && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+		site.count.store(1, std::memory_order_relaxed);
+		return site.suppressed.exchange(0, std::memory_order_relaxed);
+	}
+
+	if (site.count.fetch_add(1, std::memory_order_relaxed) < _rate_limit) {
+		return 0;
+	}
+
+	site.suppressed.fetch_add(1, std::memory_order_relaxed);
+	return -1;
+}
+
+void AsyncLogSink::Push(Module::LogSeverity severity, const char* file, int line, const char* message, size_t length, int64_t suppressed) {
+	size_t position = _enqueue.load(std::memory_order_relaxed);
+	Slot* slot;
+
+	for (;;) {
+		slot = &_slots[position % kSlots];
+
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+		if (!difference) {
+			if (_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return;
+		}
+		else {
+			position = _enqueue.load(std::memory_order_relaxed);
+		}
+	}
+
+	while (length && (message[length - 1] == '\n' || message[length - 1] == '\r')) {
+		length--;
+	}
+
+	int prefix = 0;
+
+	if (file) {
+		const char* base = std::strrchr(file, '/');
+		const char* windows = std::strrchr(file, '\\');
+
+		base = (windows > base) ? windows : base;
+		prefix = snprintf(slot->line, kLineSize, "(%s:%d) %s ", base ? base + 1 : file, line, Tag(severity));
+	}
+	else {
+		prefix = snprintf(slot->line, kLineSize, "%s ", Tag(severity));
+	}
+
+	size_t used = (prefix > 0) ? std::min(static_cast<size_t>(prefix), kLineSize - 1) : 0;
+	size_t copy = std::min(length, kLineSize - 1 - used);
+
+	memcpy(slot->line + used, message, copy);
+	used += copy;
+
+	if (suppressed > 0) {
+		int note = snprintf(slot->line + used, kLineSize - used, " (%" PRId64 " suppressed)", suppressed);
+		used = std::min(used + static_cast<size_t>(note > 0 ? note : 0), kLineSize - 1);
+	}
+
+	slot->severity = severity;
+	slot->length = static_cast<uint16_t>(used);
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	if (_waiting.load(std::memory_order_relaxed)) {
+		_cnd.notify_one();
+	}
+}
+
+void AsyncLogSink::Run() {
+	size_t position = 0;
+	char line[kLineSize + 1];
+
+	for (;;) {
+		Slot& slot = _slots[position % kSlots];
+
+		if (slot.sequence.load(std::memory_order_acquire) == position + 1) {
+			Module::LogSeverity severity = slot.severity;
+			size_t length = slot.length;
+
+			memcpy(line, slot.line, length);
+			slot.sequence.store(position + kSlots, std::memory_order_release);
+			position++;
+
+			if (_callback) {
+				line[length] = 0;
+				_callback(severity, line, length);
+			}
+			else {
+				line[length] = '\n';
+				fwrite(line, 1, length + 1, stderr);
+			}
+
+			continue;
+		}
+
+		if (_stopping.load(std::memory_order_acquire)) {
+			return;
+		}
+
+		// Producers only notify while the thread is waiting, a missed notification costs at most one timeout.
+		std::unique_lock<std::mutex> lock(_mutex);
+		_waiting.store(true, std::memory_order_relaxed);
+		_cnd.wait_for(lock, std::chrono::milliseconds(20));
+		_waiting.store(false, std::memory_order_relaxed);
+	}
+}
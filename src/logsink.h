@@ -0,0 +1,68 @@
+#ifndef CRTC_LOGSINK_H
+#define CRTC_LOGSINK_H
+
+#include "crtc.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <rtc_base/logging.h>
+
+namespace crtc {
+	// Replaces WebRTC's synchronous stderr logging. Logging threads format a line straight into a slot of a
+	// bounded lock-free ring (sequence numbered slots, any number of producers) and a single background
+	// thread writes the slots out. A full ring drops lines instead of blocking the caller, and every call
+	// site may log a limited number of lines per second.
+	class AsyncLogSink : public rtc::LogSink {
+		AsyncLogSink(const AsyncLogSink&) = delete;
+		AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+	public:
+		static void Start(Module::LogSeverity severity, std::function<void(Module::LogSeverity, const char*, size_t)> callback, uint32_t rateLimit);
+		static void Stop();
+
+		~AsyncLogSink() override;
+
+	private:
+		static const size_t kSlots = 1024;
+		static const size_t kLineSize = 240;
+		static const size_t kCallSites = 1024;
+
+		struct Slot {
+			std::atomic<size_t> sequence;
+			Module::LogSeverity severity;
+			uint16_t length;
+			char line[kLineSize];
+		};
+
+		struct CallSite {
+			std::atomic<int64_t> window;
+			std::atomic<uint32_t> count;
+			std::atomic<uint32_t> suppressed;
+		};
+
+		AsyncLogSink(std::function<void(Module::LogSeverity, const char*, size_t)>&& callback, uint32_t rateLimit);
+
+		void OnLogMessage(const std::string& message) override;
+		void OnLogMessage(const std::string& message, rtc::LoggingSeverity severity) override;
+		void OnLogMessage(const rtc::LogLineRef& line) override;
+
+		// Returns the number of lines suppressed before this one, or -1 when this line is suppressed.
+		int64_t Admit(const char* file, int line);
+		void Push(Module::LogSeverity severity, const char* file, int line, const char* message, size_t length, int64_t suppressed);
+		void Run();
+
+		std::function<void(Module::LogSeverity, const char*, size_t)> _callback;
+		uint32_t _rate_limit;
+		std::unique_ptr<Slot[]> _slots;
+		std::unique_ptr<CallSite[]> _sites;
+		alignas(64) std::atomic<size_t> _enqueue;
+		std::atomic<bool> _waiting;
+		std::atomic<bool> _stopping;
+		std::mutex _mutex;
+		std::condition_variable _cnd;
+		std::thread _thread;
+	};
+}
+
+#endif
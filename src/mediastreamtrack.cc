@@ -25,6 +25,9 @@
 
 #include "crtc.h"
 #include "mediastreamtrack.h"
+#include "decodeswitch.h"
+#include "metrics.h"
+#include "trace.h"
 #include "rtc_base/logging.h"
 #include "videoframe.h"
 
@@ -75,7 +78,8 @@ webrtc::MediaStreamTrackInterface* MediaStreamTrackInternal::New(const std::shar
 */
 
 MediaStreamTrackInternal::MediaStreamTrackInternal(webrtc::MediaStreamTrackInterface* track) :
-	_track(track)
+	_track(track),
+	_consumer(false)
 {
 	_kind = track->kind() == webrtc::MediaStreamTrackInterface::kAudioKind ? MediaStreamTrack::kAudio : MediaStreamTrack::kVideo;
 
@@ -101,9 +105,14 @@ MediaStreamTrackInternal::MediaStreamTrackInternal(webrtc::MediaStreamTrackInter
 		video->set_enabled(true);
 		
 	}
+
+	if (Remote()) {
+		_decode_switch = DecodeSwitch::For(_track);
+	}
 }
 
 MediaStreamTrackInternal::~MediaStreamTrackInternal() {
+	SetConsumer(false);
 
 	if (_kind == MediaStreamTrack::Type::kAudio) {
 		webrtc::AudioTrackInterface* audio = static_cast<webrtc::AudioTrackInterface*>(_track.get());
@@ -120,14 +129,17 @@ MediaStreamTrackInternal::~MediaStreamTrackInternal() {
 
 void MediaStreamTrackInternal::OnData(const void* audio_data, int bits_per_sample, int sample_rate, size_t number_of_channels, size_t number_of_frames)
 {
+	CRTC_TRACE_SCOPE("media", "OnData");
 	_onAudio(audio_data, bits_per_sample, sample_rate, number_of_channels, number_of_frames);
 }
 
 void MediaStreamTrackInternal::OnFrame(const webrtc::VideoFrame& frame) {
+	CRTC_TRACE_SCOPE("media", "OnFrame");
 	_onVideo(std::make_shared<VideoFrameInternal>(frame));
 }
 
 void MediaStreamTrackInternal::OnDiscardedFrame() {
+	MetricsRegistry::Add(MetricsRegistry::kFramesDropped);
 	_onFrameDrop();
 }
 
@@ -208,11 +220,19 @@ void crtc::MediaStreamTrackInternal::onUnmute(std::function<void()> callback)
 
 void crtc::MediaStreamTrackInternal::onAudio(std::function<void(const void*, int, int, size_t, size_t)> callback)
 {
+	if (_kind == MediaStreamTrack::kAudio) {
+		SetConsumer(static_cast<bool>(callback));
+	}
+
 	_onAudio = callback;
 }
 
 void crtc::MediaStreamTrackInternal::onVideo(std::function<void(std::shared_ptr<VideoFrame>)> callback)
 {
+	if (_kind == MediaStreamTrack::kVideo) {
+		SetConsumer(static_cast<bool>(callback));
+	}
+
 	_onVideo = callback;
 }
 
@@ -221,6 +241,31 @@ void crtc::MediaStreamTrackInternal::onFrameDrop(std::function<void()> callback)
 	_onFrameDrop = callback;
 }
 
+void crtc::MediaStreamTrackInternal::SetDecodeMode(MediaStreamTrack::DecodeMode mode)
+{
+	if (_decode_switch) {
+		_decode_switch->SetMode(mode);
+	}
+}
+
+MediaStreamTrack::DecodeMode crtc::MediaStreamTrackInternal::GetDecodeMode() const
+{
+	return _decode_switch ? _decode_switch->Mode() : MediaStreamTrack::kDecodeAuto;
+}
+
+// Counts this wrapper as a consumer of decoded frames while it has a frame callback.
+void crtc::MediaStreamTrackInternal::SetConsumer(bool consumer)
+{
+	if (_decode_switch && _consumer.exchange(consumer) != consumer) {
+		if (consumer) {
+			_decode_switch->AddConsumer();
+		}
+		else {
+			_decode_switch->RemoveConsumer();
+		}
+	}
+}
+
 rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> MediaStreamTrackInternal::GetTrack() const {
 	return _track;
 }
@@ -30,8 +30,11 @@
 #include "crtc.h"
 #include "utils.hpp"
 #include <api/media_stream_interface.h>
+#include <atomic>
 
 namespace crtc {
+	class DecodeSwitch;
+
 	class MediaStreamTrackInternal : public MediaStreamTrack, public webrtc::ObserverInterface, 
 		webrtc::AudioTrackSinkInterface, rtc::VideoSinkInterface<webrtc::VideoFrame> {
 
@@ -55,6 +58,9 @@ namespace crtc {
 		void onVideo(std::function<void(std::shared_ptr<VideoFrame>)> callback) override;
 		void onFrameDrop(std::function<void()> callback) override;
 
+		void SetDecodeMode(MediaStreamTrack::DecodeMode mode) override;
+		MediaStreamTrack::DecodeMode GetDecodeMode() const override;
+
 		rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> GetTrack() const;
 		webrtc::MediaSourceInterface* GetSource() const;
 
@@ -62,6 +68,7 @@ namespace crtc {
 
 	private:
 		void OnChanged() override;
+		void SetConsumer(bool consumer);
 
 	protected:
 		virtual void OnData(const void* audio_data, int bits_per_sample, int sample_rate, size_t number_of_channels, size_t number_of_frames) override;
@@ -86,6 +93,10 @@ namespace crtc {
 		synchronized_callback<const void*, int, int, size_t, size_t> _onAudio;
 		synchronized_callback<std::shared_ptr<VideoFrame>> _onVideo;
 		synchronized_callback<> _onFrameDrop;
+
+		// Null for local tracks.
+		std::shared_ptr<DecodeSwitch> _decode_switch;
+		std::atomic<bool> _consumer;
 	};
 }
 
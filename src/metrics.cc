@@ -0,0 +1,275 @@
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+using namespace crtc;
+
+namespace {
+	const uint32_t kShards = 16;
+
+	// Values below 8us get a bucket each, every power of two above is split into four up to 2^32us.
+	const uint32_t kLinear = 8;
+	const uint32_t kBuckets = kLinear + 29 * 4;
+
+	struct alignas(64) Shard {
+		std::atomic<int64_t> counters[MetricsRegistry::kCounters];
+		std::atomic<uint64_t> sums[MetricsRegistry::kHistograms];
+		std::atomic<uint64_t> buckets[MetricsRegistry::kHistograms][kBuckets];
+	};
+
+	Shard shards[kShards];
+	std::atomic<bool> recording(false);
+	std::atomic<uint32_t> nextShard(0);
+
+	const char* counterNames[MetricsRegistry::kCounters][3] = {
+		{ "crtc_tasks_posted_total", "counter", "Tasks posted to an executor." },
+		{ "crtc_tasks_completed_total", "counter", "Posted tasks that have run or were dropped." },
+		{ "crtc_dispatch_iterations_total", "counter", "Iterations of Module::DispatchEvents()." },
+		{ "crtc_sdp_operations_total", "counter", "Offer/answer and description operations completed or aborted." },
+		{ "crtc_datachannel_send_failures_total", "counter", "RTCDataChannel::Send() calls rejected by WebRTC." },
+		{ "crtc_frames_dropped_total", "counter", "Video frames discarded by WebRTC before reaching a sink." },
+		{ "crtc_audio_queue_depth", "gauge", "Audio buffers waiting to be consumed by WebRTC." },
+	};
+
+	const char* histogramNames[MetricsRegistry::kHistograms][2] = {
+		{ "crtc_task_queue_latency_seconds", "Time from posting a task until it starts." },
+		{ "crtc_dispatch_loop_seconds", "Duration of a Module::DispatchEvents() iteration." },
+		{ "crtc_sdp_operation_latency_seconds", "Time from queuing an SDP operation until its result is posted." },
+	};
+
+	Shard& LocalShard() {
+		thread_local uint32_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+		return shards[shard];
+	}
+
+	int64_t Clock() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	uint32_t BucketOf(uint64_t us) {
+		if (us < kLinear) {
+			return static_cast<uint32_t>(us);
+		}
+
+		uint32_t log2 = 0;
+
+		for (uint64_t value = us; value > 1; value >>= 1) {
+			log2++;
+		}
+
+		uint32_t bucket = kLinear + (log2 - 3) * 4 + static_cast<uint32_t>((us >> (log2 - 2)) & 3);
+		return (bucket < kBuckets) ? bucket : kBuckets - 1;
+	}
+
+	// Largest value falling into the bucket.
+	uint64_t UpperBound(uint32_t bucket) {
+		if (bucket < kLinear) {
+			return bucket;
+		}
+
+		uint32_t log2 = (bucket - kLinear) / 4 + 3;
+		uint64_t sub = (bucket - kLinear) % 4;
+
+		return ((5 + sub) << (log2 - 2)) - 1;
+	}
+
+	struct Buckets {
+		uint64_t counts[kBuckets];
+		uint64_t count;
+		uint64_t sum;
+	};
+
+	void Collect(MetricsRegistry::Histogram histogram, Buckets& result) {
+		result = Buckets();
+
+		for (const auto& shard : shards) {
+			result.sum += shard.sums[histogram].load(std::memory_order_relaxed);
+
+			for (uint32_t bucket = 0; bucket < kBuckets; bucket++) {
+				uint64_t count = shard.buckets[histogram][bucket].load(std::memory_order_relaxed);
+
+				result.counts[bucket] += count;
+				result.count += count;
+			}
+		}
+	}
+
+	double Percentile(const Buckets& buckets, double percentile) {
+		if (!buckets.count) {
+			return 0;
+		}
+
+		uint64_t rank = std::min(static_cast<uint64_t>(buckets.count * percentile), buckets.count - 1);
+		uint64_t seen = 0;
+
+		for (uint32_t bucket = 0; bucket < kBuckets; bucket++) {
+			seen += buckets.counts[bucket];
+
+			if (seen > rank) {
+				return static_cast<double>(UpperBound(bucket));
+			}
+		}
+
+		return 0;
+	}
+
+	Module::Metrics::Latency Summarize(MetricsRegistry::Histogram histogram) {
+		Buckets buckets;
+		Module::Metrics::Latency latency;
+
+		Collect(histogram, buckets);
+
+		latency.count = buckets.count;
+		latency.sumUs = static_cast<double>(buckets.sum);
+		latency.p50Us = Percentile(buckets, 0.5);
+		latency.p90Us = Percentile(buckets, 0.9);
+		latency.p99Us = Percentile(buckets, 0.99);
+		latency.maxUs = Percentile(buckets, 1.0);
+
+		return latency;
+	}
+
+	int64_t Total(MetricsRegistry::Counter counter) {
+		int64_t total = 0;
+
+		for (const auto& shard : shards) {
+			total += shard.counters[counter].load(std::memory_order_relaxed);
+		}
+
+		return total;
+	}
+
+	void CpuTime(double& user, double& system) {
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, usr;
+
+		if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &usr)) {
+			user = static_cast<double>((static_cast<uint64_t>(usr.dwHighDateTime) << 32) | usr.dwLowDateTime) / 1e7;
+			system = static_cast<double>((static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) / 1e7;
+		}
+#else
+		struct rusage usage;
+
+		if (!getrusage(RUSAGE_SELF, &usage)) {
+			user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+			system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		}
+#endif
+	}
+}
+
+void MetricsRegistry::Add(Counter counter, int64_t value) {
+	LocalShard().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+int64_t MetricsRegistry::Now() {
+	if (!recording.load(std::memory_order_relaxed)) {
+		return 0;
+	}
+
+	return Clock();
+}
+
+void MetricsRegistry::Record(Histogram histogram, int64_t startUs) {
+	if (!startUs) {
+		return;
+	}
+
+	int64_t elapsed = Clock() - startUs;
+	uint64_t us = (elapsed > 0) ? static_cast<uint64_t>(elapsed) : 0;
+	Shard& shard = LocalShard();
+
+	shard.sums[histogram].fetch_add(us, std::memory_order_relaxed);
+	shard.buckets[histogram][BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+Module::Metrics MetricsRegistry::Snapshot() {
+	Module::Metrics metrics;
+
+	recording.store(true, std::memory_order_relaxed);
+
+	metrics.tasksPosted = static_cast<uint64_t>(Total(kTasksPosted));
+	metrics.tasksCompleted = static_cast<uint64_t>(Total(kTasksCompleted));
+	metrics.taskQueueDepth = static_cast<int64_t>(metrics.tasksPosted - metrics.tasksCompleted);
+	metrics.dispatchIterations = static_cast<uint64_t>(Total(kDispatchIterations));
+	metrics.sdpOperations = static_cast<uint64_t>(Total(kSdpOperations));
+	metrics.dataChannelSendFailures = static_cast<uint64_t>(Total(kDataChannelSendFailures));
+	metrics.framesDropped = static_cast<uint64_t>(Total(kFramesDropped));
+	metrics.audioQueueDepth = Total(kAudioQueueDepth);
+	metrics.cpuUserSeconds = 0;
+	metrics.cpuSystemSeconds = 0;
+
+	CpuTime(metrics.cpuUserSeconds, metrics.cpuSystemSeconds);
+
+	metrics.taskQueueLatency = Summarize(kTaskQueueLatency);
+	metrics.dispatchLoopTime = Summarize(kDispatchLoopTime);
+	metrics.sdpOperationLatency = Summarize(kSdpOperationLatency);
+
+	return metrics;
+}
+
+std::string MetricsRegistry::Prometheus() {
+	std::string text;
+	char line[256];
+	double user = 0, system = 0;
+
+	recording.store(true, std::memory_order_relaxed);
+
+	for (int counter = 0; counter < kCounters; counter++) {
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %" PRId64 "\n",
+			counterNames[counter][0], counterNames[counter][2], counterNames[counter][0], counterNames[counter][1],
+			counterNames[counter][0], Total(static_cast<Counter>(counter)));
+
+		text += line;
+	}
+
+	CpuTime(user, system);
+
+	snprintf(line, sizeof(line), "# HELP crtc_cpu_seconds_total Process CPU time.\n# TYPE crtc_cpu_seconds_total counter\n"
+		"crtc_cpu_seconds_total{mode=\"user\"} %.6f\ncrtc_cpu_seconds_total{mode=\"system\"} %.6f\n", user, system);
+
+	text += line;
+
+	for (int histogram = 0; histogram < kHistograms; histogram++) {
+		const char* name = histogramNames[histogram][0];
+		Buckets buckets;
+		uint64_t cumulative = 0;
+		uint64_t limit = 1;
+
+		Collect(static_cast<Histogram>(histogram), buckets);
+
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, histogramNames[histogram][1], name);
+		text += line;
+
+		// Exported with one bucket per power of two, so the label set stays stable between scrapes. The bound is
+		// the largest value of the bucket holding the power of two, le is inclusive. The last bucket also holds
+		// everything above it and is left to +Inf.
+		for (uint32_t bucket = 0; bucket < kBuckets; bucket++) {
+			cumulative += buckets.counts[bucket];
+
+			if (UpperBound(bucket) >= limit && bucket < kBuckets - 1) {
+				snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %" PRIu64 "\n", name, UpperBound(bucket) / 1e6, cumulative);
+				text += line;
+
+				while (limit <= UpperBound(bucket)) {
+					limit <<= 1;
+				}
+			}
+		}
+
+		snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n%s_sum %.6f\n%s_count %" PRIu64 "\n",
+			name, cumulative, name, buckets.sum / 1e6, name, buckets.count);
+
+		text += line;
+	}
+
+	return text;
+}
@@ -0,0 +1,44 @@
+#ifndef CRTC_METRICS_H
+#define CRTC_METRICS_H
+
+#include "crtc.h"
+#include <atomic>
+#include <string>
+
+namespace crtc {
+	// Fixed set of counters and latency histograms updated on the library's hot paths. Every thread
+	// writes to its own cache-line aligned shard with relaxed atomics, readers sum the shards. Latencies
+	// are recorded into log-linear buckets (four per power of two, in microseconds) and are only
+	// timed once somebody has asked for a snapshot, until then Now() returns 0 without reading a clock.
+	class CRTC_EXPORT MetricsRegistry {
+	public:
+		enum Counter {
+			kTasksPosted,
+			kTasksCompleted,
+			kDispatchIterations,
+			kSdpOperations,
+			kDataChannelSendFailures,
+			kFramesDropped,
+			kAudioQueueDepth,
+			kCounters,
+		};
+
+		enum Histogram {
+			kTaskQueueLatency,
+			kDispatchLoopTime,
+			kSdpOperationLatency,
+			kHistograms,
+		};
+
+		static void Add(Counter counter, int64_t value = 1);
+
+		// Start time for Record(), 0 while latencies are not being recorded.
+		static int64_t Now();
+		static void Record(Histogram histogram, int64_t startUs);
+
+		static Module::Metrics Snapshot();
+		static std::string Prometheus();
+	};
+}
+
+#endif
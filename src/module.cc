@@ -25,11 +25,16 @@
 
 #include "crtc.h"
 #include "module.h"
+#include "customvideoencoderfactory.h"
+#include "executor.h"
+#include "logsink.h"
+#include "metrics.h"
+#include "peerconnectionpool.h"
 #include "rtcpeerconnection.h"
+#include "trace.h"
 #include "rtc_base/thread.h"
 #include "rtc_base/ssl_adapter.h"
 #include "rtc_base/physical_socket_server.h"
-#include <base/atomicops.h>
 
 #if defined(_MSC_VER)
     #include "rtc_base/win32_socket_init.h"
@@ -37,7 +42,7 @@
 
 using namespace crtc;
 
-volatile intptr_t ModuleInternal::pending_events = 0;
+PendingEvents ModuleInternal::pending_events;
 synchronized_callback<> asyncCallback;
 
 class Thread : public rtc::AutoThread {
@@ -69,18 +74,66 @@ public:
 
 Thread currentThread;
 
-void Module::Init() {
+std::shared_ptr<Executor> ModuleInternal::main_executor = std::make_shared<LoopExecutor>(&currentThread);
+std::shared_ptr<Executor> ModuleInternal::default_executor = ModuleInternal::main_executor;
+TimerWheel ModuleInternal::timers;
+
+std::shared_ptr<Executor> ModuleInternal::DefaultExecutor() {
+    return std::atomic_load(&default_executor);
+}
+
+void ModuleInternal::SetDefaultExecutor(std::shared_ptr<Executor> executor) {
+    std::atomic_store(&default_executor, std::move(executor));
+}
+
+void ModuleInternal::WakeTimers(int delayMs) {
+    // Straight to the thread, Executor::Post() with a delay would go through the wheel again.
+    currentThread.PostDelayedTask([]() { ModuleInternal::timers.Fire(); }, webrtc::TimeDelta::Millis(delayMs));
+}
+
+Module::Options::Options() :
+#ifdef NDEBUG
+    logSeverity(kLogError),
+#else
+    logSeverity(kLogInfo),
+#endif
+    logRateLimit(0),
+    dispatcherThreads(0),
+    timerSlackMs(4),
+    peerConnectionPoolSize(0),
+    certificatePoolSize(0),
+    shareCertificates(false),
+    certificateRotationMs(0),
+    broadcastKeyFrameIntervalMs(500)
+{
+    videoEncoders.push_back(VideoEncoderSettings(kH264));
+    videoEncoders.push_back(VideoEncoderSettings(kVP8));
+    videoEncoders.push_back(VideoEncoderSettings(kVP9));
+    videoEncoders.push_back(VideoEncoderSettings(kAV1));
+}
+
+void Module::Init(const Options& options) {
     rtc::ThreadManager::Instance()->SetCurrentThread(&currentThread);
-//#ifdef NDEBUG
-//    rtc::LogMessage::LogToDebug(rtc::LS_ERROR);
-//#else
-	rtc::LogMessage::LogToDebug(rtc::LS_VERBOSE);
-//#endif
+
+    ModuleInternal::timers.SetResolution(options.timerSlackMs);
+
+    if (options.dispatcherThreads) {
+        ModuleInternal::SetDefaultExecutor(PoolExecutor::New(options.dispatcherThreads));
+    }
+
+	AsyncLogSink::Start(options.logSeverity, options.logCallback, options.logRateLimit);
 	rtc::InitializeSSL();
+
+	// Before the pool starts, pooled connections build their encoder factory right away.
+	CustomVideoEncoderFactory::Configure(options.videoEncoders, options.broadcastKeyFrameIntervalMs);
+	PeerConnectionPool::Start(options.peerConnectionPoolSize, options.certificatePoolSize, options.shareCertificates, options.certificateRotationMs);
 }
 
 void Module::Dispose() {
+	PeerConnectionPool::Stop();
+	ModuleInternal::SetDefaultExecutor(ModuleInternal::main_executor);
 	rtc::CleanupSSL();
+	AsyncLogSink::Stop();
 }
 
 bool Module::DispatchEvents(bool kForever) {
@@ -88,7 +141,14 @@ bool Module::DispatchEvents(bool kForever) {
 	//rtc::Thread* thread = rtc::ThreadManager::Instance()->CurrentThread();
 
 	do {
-		result = (base::subtle::NoBarrier_Load(&ModuleInternal::pending_events) > 0 && currentThread.ProcessMessages(kForever ? 1000 : 0));
+		int64_t start = MetricsRegistry::Now();
+		int timeout = ModuleInternal::timers.Advance(Time::Now());
+		int wait = (kForever) ? ((timeout >= 0 && timeout < 1000) ? timeout : 1000) : 0;
+
+		result = (ModuleInternal::pending_events.IsActive() && currentThread.ProcessMessages(wait));
+
+		MetricsRegistry::Add(MetricsRegistry::kDispatchIterations);
+		MetricsRegistry::Record(MetricsRegistry::kDispatchLoopTime, start);
 	} while (kForever && result);
 
 	return result;
@@ -102,13 +162,45 @@ void Module::UnregisterAsyncCallback() {
     asyncCallback = nullptr;
 }
 
-void Async::Call(std::function<void()> callback, int delayMs) {
-    //rtc::Thread* target = rtc::ThreadManager::Instance()->CurrentThread();
-    auto event = Event::New();
-    if (delayMs > 0) {
-        currentThread.PostDelayedTask([callback, event]() { callback(); }, webrtc::TimeDelta::Millis(delayMs));
+Module::Metrics Module::GetMetrics() {
+    return MetricsRegistry::Snapshot();
+}
+
+String Module::GetPrometheusMetrics() {
+    std::string text = MetricsRegistry::Prometheus();
+    return String(text.c_str(), text.size());
+}
+
+void Module::StartTracing() {
+    Trace::Start();
+}
+
+void Module::StopTracing() {
+    Trace::Stop();
+}
+
+String Module::GetTrace() {
+    std::string json = Trace::Dump();
+    return String(json.c_str(), json.size());
+}
+
+void Async::Call(Task task, int delayMs) {
+    ModuleInternal::DefaultExecutor()->Post(std::move(task), delayMs);
+}
+
+void Async::Call(const std::shared_ptr<Executor>& executor, Task task, int delayMs) {
+    if (executor) {
+        executor->Post(std::move(task), delayMs);
     }
     else {
-        currentThread.PostTask([callback, event]() { callback(); });
+        ModuleInternal::DefaultExecutor()->Post(std::move(task), delayMs);
     }
 }
+
+uint64_t Async::Timeout(Task task, int delayMs, const std::shared_ptr<Executor>& executor) {
+    return ModuleInternal::timers.Schedule(executor ? executor : ModuleInternal::DefaultExecutor(), std::move(task), delayMs);
+}
+
+bool Async::Cancel(uint64_t timeout) {
+    return ModuleInternal::timers.Cancel(timeout);
+}
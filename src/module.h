@@ -28,11 +28,25 @@
 #define CRTC_MODULE_H
 
 #include "crtc.h"
+#include "pendingevents.h"
+#include "timerwheel.h"
 
 namespace crtc {
 	class ModuleInternal {
 	public:
-		static volatile intptr_t pending_events;
+		static PendingEvents pending_events;
+		static std::shared_ptr<Executor> main_executor;
+		static TimerWheel timers;
+
+		// Read from any thread while Init() and Dispose() replace it, only ever accessed atomically.
+		static std::shared_ptr<Executor> DefaultExecutor();
+		static void SetDefaultExecutor(std::shared_ptr<Executor> executor);
+
+		// Posts TimerWheel::Fire() to the module loop after delayMs.
+		static void WakeTimers(int delayMs);
+
+	private:
+		static std::shared_ptr<Executor> default_executor;
 	};
 }
 
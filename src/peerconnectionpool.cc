@@ -0,0 +1,188 @@
+#include "peerconnectionpool.h"
+#include "rtcpeerconnection.h"
+#include <rtc_base/rtc_certificate_generator.h>
+#include <deque>
+#include <mutex>
+
+using namespace crtc;
+
+namespace {
+	struct CachedCertificate {
+		rtc::scoped_refptr<rtc::RTCCertificate> certificate;
+		int64_t created;
+	};
+
+	struct PoolState {
+		std::mutex mutex;
+		std::deque<std::shared_ptr<RTCPeerConnectionInternal>> connections;
+		std::deque<CachedCertificate> certificates;
+		size_t connectionTarget = 0;
+		size_t certificateTarget = 0;
+		size_t nextCertificate = 0;
+		bool shareCertificates = false;
+		int64_t rotationMs = 0;
+		bool refilling = false;
+	};
+
+	// Never destroyed, pooled connections must not be torn down during static destruction.
+	PoolState& State() {
+		static PoolState* state = new PoolState();
+		return *state;
+	}
+
+	// Called with the lock held. Index of the oldest certificate due for rotation, or the cache size.
+	size_t StaleCertificate(const PoolState& state, int64_t now) {
+		size_t stale = state.certificates.size();
+
+		if (!state.shareCertificates || state.rotationMs <= 0) {
+			return stale;
+		}
+
+		for (size_t index = 0; index < state.certificates.size(); index++) {
+			if (now - state.certificates[index].created >= state.rotationMs &&
+				(stale == state.certificates.size() || state.certificates[index].created < state.certificates[stale].created))
+			{
+				stale = index;
+			}
+		}
+
+		return stale;
+	}
+
+	// Called with the lock held.
+	bool NeedsCertificate(const PoolState& state, int64_t now) {
+		return state.certificates.size() < state.certificateTarget || StaleCertificate(state, now) < state.certificates.size();
+	}
+
+	void Refill() {
+		PoolState& state = State();
+
+		for (;;) {
+			bool connection = false;
+			bool certificate = false;
+
+			{
+				std::lock_guard<std::mutex> lock(state.mutex);
+
+				connection = state.connections.size() < state.connectionTarget;
+				certificate = NeedsCertificate(state, Time::Now());
+
+				if (!connection && !certificate) {
+					state.refilling = false;
+					return;
+				}
+			}
+
+			// Constructed outside of the lock, each one takes a few milliseconds.
+			std::shared_ptr<RTCPeerConnectionInternal> pc = connection ? std::make_shared<RTCPeerConnectionInternal>() : nullptr;
+			rtc::scoped_refptr<rtc::RTCCertificate> cert = certificate ? rtc::RTCCertificateGenerator::GenerateCertificate(rtc::KeyParams(rtc::KT_ECDSA), absl::nullopt) : nullptr;
+			int64_t now = Time::Now();
+
+			std::lock_guard<std::mutex> lock(state.mutex);
+
+			if (pc && state.connections.size() < state.connectionTarget) {
+				state.connections.push_back(std::move(pc));
+			}
+
+			if (cert) {
+				size_t stale = StaleCertificate(state, now);
+
+				if (state.certificates.size() < state.certificateTarget) {
+					state.certificates.push_back({ std::move(cert), now });
+				}
+				else if (stale < state.certificates.size()) {
+					// Connections using the old certificate keep their reference.
+					state.certificates[stale] = { std::move(cert), now };
+				}
+			}
+			else if (certificate) {
+				// Key generation failed, retrying in a loop would not help.
+				state.certificateTarget = state.certificates.size();
+				state.rotationMs = 0;
+			}
+		}
+	}
+
+	// Called with the lock held.
+	void ScheduleRefill(PoolState& state) {
+		if (state.refilling || (!state.connectionTarget && !state.certificateTarget)) {
+			return;
+		}
+
+		if (state.connections.size() < state.connectionTarget || NeedsCertificate(state, Time::Now())) {
+			state.refilling = true;
+			PeerConnectionPool::BackgroundExecutor()->Post(Refill);
+		}
+	}
+}
+
+void PeerConnectionPool::Start(size_t connections, size_t certificates, bool shareCertificates, int64_t rotationMs) {
+	PoolState& state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	state.connectionTarget = connections;
+	state.certificateTarget = certificates;
+	state.shareCertificates = shareCertificates;
+	state.rotationMs = rotationMs;
+
+	ScheduleRefill(state);
+}
+
+void PeerConnectionPool::Stop() {
+	PoolState& state = State();
+	std::deque<std::shared_ptr<RTCPeerConnectionInternal>> connections;
+
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		state.connectionTarget = 0;
+		state.certificateTarget = 0;
+		state.certificates.clear();
+
+		connections.swap(state.connections);
+	}
+}
+
+std::shared_ptr<RTCPeerConnectionInternal> PeerConnectionPool::Acquire() {
+	PoolState& state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	if (state.connections.empty()) {
+		ScheduleRefill(state);
+		return nullptr;
+	}
+
+	auto pc = std::move(state.connections.front());
+	state.connections.pop_front();
+
+	ScheduleRefill(state);
+	return pc;
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate> PeerConnectionPool::AcquireCertificate() {
+	PoolState& state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	rtc::scoped_refptr<rtc::RTCCertificate> certificate;
+
+	if (state.certificates.empty()) {
+		ScheduleRefill(state);
+		return nullptr;
+	}
+
+	if (state.shareCertificates) {
+		// Stale certificates are still valid, they are handed out until their replacement is ready.
+		certificate = state.certificates[state.nextCertificate++ % state.certificates.size()].certificate;
+	}
+	else {
+		certificate = std::move(state.certificates.front().certificate);
+		state.certificates.pop_front();
+	}
+
+	ScheduleRefill(state);
+	return certificate;
+}
+
+std::shared_ptr<Executor> PeerConnectionPool::BackgroundExecutor() {
+	static std::shared_ptr<Executor> executor = Executor::NewLoop(String("prewarm"));
+	return executor;
+}
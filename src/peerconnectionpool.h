@@ -0,0 +1,30 @@
+#ifndef CRTC_PEERCONNECTIONPOOL_H
+#define CRTC_PEERCONNECTIONPOOL_H
+
+#include "crtc.h"
+#include <rtc_base/rtc_certificate.h>
+
+namespace crtc {
+	class RTCPeerConnectionInternal;
+
+	// Connections constructed ahead of time (threads and media factories, no transport yet) and DTLS
+	// certificates generated ahead of time. Both are topped up on a background thread whenever they
+	// drop below their target size, which keeps that work off the join path.
+	//
+	// Certificates are handed out once each, or when shared, round-robin to every connection and
+	// replaced in the background once they are older than the rotation period.
+	class PeerConnectionPool {
+	public:
+		static void Start(size_t connections, size_t certificates, bool shareCertificates = false, int64_t rotationMs = 0);
+		static void Stop();
+
+		// nullptr when the pool is empty or disabled.
+		static std::shared_ptr<RTCPeerConnectionInternal> Acquire();
+		static rtc::scoped_refptr<rtc::RTCCertificate> AcquireCertificate();
+
+		// Background loop used for construction and key generation.
+		static std::shared_ptr<Executor> BackgroundExecutor();
+	};
+}
+
+#endif
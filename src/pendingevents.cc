@@ -0,0 +1,57 @@
+#include "pendingevents.h"
+
+using namespace crtc;
+
+namespace {
+	std::atomic<uint32_t> nextShard(0);
+
+	uint32_t CurrentShard() {
+		thread_local uint32_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % PendingEvents::kShards;
+		return shard;
+	}
+}
+
+uint32_t PendingEvents::Acquire() {
+	uint32_t index = CurrentShard();
+	std::atomic<intptr_t>& count = _shards[index].count;
+	intptr_t value = count.load(std::memory_order_relaxed);
+
+	for (;;) {
+		if (value) {
+			if (count.compare_exchange_weak(value, value + 1, std::memory_order_relaxed)) {
+				return index;
+			}
+
+			continue;
+		}
+
+		// Announce the shard before it becomes non-zero so IsActive() can never undercount.
+		_active.fetch_add(1, std::memory_order_acq_rel);
+
+		if (count.compare_exchange_strong(value, 1, std::memory_order_acq_rel)) {
+			return index;
+		}
+
+		_active.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+void PendingEvents::Release(uint32_t shard) {
+	if (_shards[shard].count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		_active.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+bool PendingEvents::IsActive() const {
+	return _active.load(std::memory_order_acquire) > 0;
+}
+
+intptr_t PendingEvents::Count() const {
+	intptr_t count = 0;
+
+	for (const auto& shard : _shards) {
+		count += shard.count.load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
@@ -0,0 +1,42 @@
+#ifndef CRTC_PENDINGEVENTS_H
+#define CRTC_PENDINGEVENTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace crtc {
+	// Liveness count of the module loop, split into cache-line sized shards picked per thread.
+	// A reference must be released with the shard it was acquired on, which keeps every shard
+	// non-negative. Only a shard's 0 <-> 1 transitions touch the shared counter, so the loop
+	// reads a single word and busy threads never contend on it.
+	class PendingEvents {
+		PendingEvents(const PendingEvents&) = delete;
+		PendingEvents& operator=(const PendingEvents&) = delete;
+
+	public:
+		static const uint32_t kShards = 32;
+
+		// Constant initialized, Events may be created while other statics are constructed.
+		constexpr PendingEvents() : _shards(), _active(0) { }
+
+		uint32_t Acquire();
+		void Release(uint32_t shard);
+
+		// False once nothing keeps the loop alive. Never reports idle while a reference is held.
+		bool IsActive() const;
+
+		// Exact sum of all shards, meant for diagnostics.
+		intptr_t Count() const;
+
+	private:
+		struct alignas(64) Shard {
+			std::atomic<intptr_t> count;
+		};
+
+		Shard _shards[kShards];
+		alignas(64) std::atomic<intptr_t> _active;
+	};
+}
+
+#endif
@@ -1,108 +1,366 @@
 #ifndef CRTC_PROMISE_H
 #define CRTC_PROMISE_H
 
-#include <memory>
+#include "crtc.h"
+#include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 
 namespace crtc {
+	template <typename... Args> class Promise;
+
+	// Promise type returned by Then() for a callback returning R. Returned promises are flattened.
+	template <typename R> struct PromiseOf { typedef Promise<R> type; };
+	template <> struct PromiseOf<void> { typedef Promise<> type; };
+	template <typename... U> struct PromiseOf<std::shared_ptr<Promise<U...>>> { typedef Promise<U...> type; };
+
 	/// \sa https://developer.mozilla.org/en/docs/Web/JavaScript/Reference/Global_Objects/Promise
+	///
+	/// The state is settled once with a compare-and-swap and continuations are pushed onto a lock-free
+	/// list, so resolve and reject may be called from any thread. Continuations run on the executor the
+	/// promise was created for. The first continuation is stored inside the promise itself.
 
-	template <typename... Args> class Promise {
+	template <typename... Args> class Promise : public std::enable_shared_from_this<Promise<Args...>> {
 		Promise<Args...>(const Promise<Args...>&) = delete;
 		Promise<Args...>& operator=(const Promise<Args...>&) = delete;
 
+		template <typename...> friend class Promise;
+
+		struct Node {
+			Task task;
+			Node* next = nullptr;
+			bool direct = false;
+		};
+
+		enum State {
+			kPending,
+			kSettling,
+			kResolved,
+			kRejected,
+		};
+
+		static constexpr uintptr_t kDone = 1;
+
 	public:
 		typedef std::function<void(Args...)> FullFilledCallback;
 		typedef std::function<void()> FinallyCallback;
 		typedef std::function<void(std::shared_ptr<Error>)> RejectedCallback;
 		typedef std::function<void(const FullFilledCallback&, const RejectedCallback&)> ExecutorCallback;
 
-		explicit Promise() { }
-		virtual ~Promise() { }
+		/// Settles the promise when called. Holds a reference, copies are cheap and thread-safe.
+		class Resolve {
+		public:
+			explicit Resolve(std::shared_ptr<Promise<Args...>> promise) : _promise(std::move(promise)) { }
 
-		inline static std::shared_ptr<Promise<Args...>> New(const ExecutorCallback& executor) {
-			auto self = std::make_shared<Promise<Args...>>();
+			void operator()(Args... args) const {
+				_promise->Fulfill(std::move(args)...);
+			}
 
-			RejectedCallback reject([=](const std::shared_ptr<Error>& error) {
-				if (self) {
-					for (const auto& callback : self->_onreject) {
-						callback(error);
-					}
+		private:
+			std::shared_ptr<Promise<Args...>> _promise;
+		};
 
-					for (const auto& callback : self->_onfinally) {
-						callback();
-					}
+		class Reject {
+		public:
+			explicit Reject(std::shared_ptr<Promise<Args...>> promise) : _promise(std::move(promise)) { }
 
-					self->_completed = true;
-					self->_onfinally.clear();
-					self->_onreject.clear();
-					self->_onresolve.clear();
+			void operator()(std::shared_ptr<Error> error) const {
+				_promise->Fail(std::move(error));
+			}
 
-                    self->_cnd.notify_all();
-				}
+		private:
+			std::shared_ptr<Promise<Args...>> _promise;
+		};
+
+		explicit Promise(std::shared_ptr<Executor> executor = Executor::Default()) :
+			_executor(std::move(executor)),
+			_state(kPending),
+			_head(0),
+			_posted(0)
+		{ }
+
+		virtual ~Promise() {
+			uintptr_t head = _head.load(std::memory_order_acquire);
+
+			if (head != kDone) {
+				Release(reinterpret_cast<Node*>(head));
+			}
+		}
+
+		template <typename F> inline static std::shared_ptr<Promise<Args...>> New(F&& executor) {
+			return New(Executor::Default(), std::forward<F>(executor));
+		}
+
+		/// Runs executor(resolve, reject) on target. The executor may take Resolve/Reject or the std::function typedefs.
+		template <typename F> inline static std::shared_ptr<Promise<Args...>> New(const std::shared_ptr<Executor>& target, F&& executor) {
+			auto self = std::make_shared<Promise<Args...>>(target);
+
+			Async::Call(target, [self, executor = std::forward<F>(executor)]() mutable {
+				executor(Resolve(self), Reject(self));
 			});
 
-			FullFilledCallback resolve([=](Args... args) {
-				if (self) {
-					for (const auto& callback : self->_onresolve) {
-						callback(std::move(args)...);
-					}
+			return self;
+		}
 
-					for (const auto& callback : self->_onfinally) {
-						callback();
+		inline static std::shared_ptr<Promise<Args...>> Resolved(const std::shared_ptr<Executor>& target, Args... args) {
+			auto self = std::make_shared<Promise<Args...>>(target);
+			self->Fulfill(std::move(args)...);
+			return self;
+		}
+
+		inline static std::shared_ptr<Promise<Args...>> Rejected(const std::shared_ptr<Executor>& target, std::shared_ptr<Error> error) {
+			auto self = std::make_shared<Promise<Args...>>(target);
+			self->Fail(std::move(error));
+			return self;
+		}
+
+		/// Returns a promise settled with the callback's result. Rejections pass through to it unchanged.
+		template <typename F, typename R = std::invoke_result_t<F&, Args&...>>
+		inline std::shared_ptr<typename PromiseOf<R>::type> Then(F&& callback) {
+			auto next = std::make_shared<typename PromiseOf<R>::type>(_executor);
+
+			AddContinuation([this, next, callback = std::forward<F>(callback)]() mutable {
+				if (_state.load(std::memory_order_acquire) == kRejected) {
+					next->Fail(_error);
+				}
+				else if constexpr (std::is_void<R>::value) {
+					std::apply(callback, *_value);
+					next->Fulfill();
+				}
+				else if constexpr (IsPromise<R>::value) {
+					R inner = std::apply(callback, *_value);
+
+					if (inner) {
+						inner->Pipe(next);
+					}
+					else {
+						next->Fail(Error::New("Invalid Promise.", __FILE__, __LINE__));
 					}
+				}
+				else {
+					next->Fulfill(std::apply(callback, *_value));
+				}
+			});
 
-					self->_completed = true;
+			return next;
+		}
 
-					self->_onfinally.clear();
-					self->_onreject.clear();
-					self->_onresolve.clear();
-                    self->_cnd.notify_all();
+		/// Catch() and Finally() observe this promise and return it, so they are usually placed at the end of a chain.
+		template <typename F> inline std::shared_ptr<Promise<Args...>> Catch(F&& callback) {
+			AddContinuation([this, callback = std::forward<F>(callback)]() mutable {
+				if (_state.load(std::memory_order_acquire) == kRejected) {
+					callback(_error);
 				}
 			});
 
+			return this->shared_from_this();
+		}
+
+		template <typename F> inline std::shared_ptr<Promise<Args...>> Finally(F&& callback) {
+			AddContinuation([callback = std::forward<F>(callback)]() mutable {
+				callback();
+			});
+
+			return this->shared_from_this();
+		}
 
-			if (executor) {
-				Async::Call([=]() { executor(resolve, reject); });
+		/// Blocks until the promise is settled. Never call this from the promise's own executor.
+		inline std::shared_ptr<Promise<Args...>> WaitForResult() {
+			if (IsSettled()) {
+				return this->shared_from_this();
 			}
-			else {
-				Async::Call([=]() { reject(Error::New("Invalid Executor Callback.", __FILE__, __LINE__)); });
+
+			std::mutex mutex;
+			std::condition_variable cnd;
+			bool completed = false;
+
+			AddContinuation([&mutex, &cnd, &completed]() {
+				std::lock_guard<std::mutex> lock(mutex);
+				completed = true;
+				cnd.notify_all();
+			}, true);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			cnd.wait(lock, [&completed] { return completed; });
+
+			return this->shared_from_this();
+		}
+
+		inline bool IsSettled() const {
+			return _head.load(std::memory_order_acquire) == kDone;
+		}
+
+	private:
+		template <typename T> struct IsPromise : std::false_type { };
+		template <typename... U> struct IsPromise<std::shared_ptr<Promise<U...>>> : std::true_type { };
+
+		// Owns a detached continuation list until it has been run on the executor.
+		class Continuations {
+		public:
+			Continuations(std::shared_ptr<Promise<Args...>> promise, Node* head, bool posted = false) : _promise(std::move(promise)), _head(head), _posted(posted) { }
+			Continuations(Continuations&& other) noexcept :
+				_promise(std::move(other._promise)),
+				_head(std::exchange(other._head, nullptr)),
+				_posted(std::exchange(other._posted, false))
+			{ }
+			Continuations(const Continuations&) = delete;
+
+			~Continuations() {
+				if (_promise) {
+					_promise->Release(_head);
+				}
+
+				Done();
 			}
 
-			return self;
+			void operator()() {
+				while (_head) {
+					Node* node = _head;
+					_head = node->next;
+					node->task();
+					_promise->Release(node, false);
+				}
+
+				Done();
+			}
+
+		private:
+			void Done() {
+				if (_posted) {
+					_posted = false;
+					_promise->_posted.fetch_sub(1, std::memory_order_acq_rel);
+				}
+			}
+
+			std::shared_ptr<Promise<Args...>> _promise;
+			Node* _head;
+			bool _posted;
+		};
+
+		void Fulfill(Args... args) {
+			int expected = kPending;
+
+			if (_state.compare_exchange_strong(expected, kSettling, std::memory_order_acquire)) {
+				_value.emplace(std::move(args)...);
+				_state.store(kResolved, std::memory_order_release);
+				Dispatch();
+			}
 		}
 
-		inline Promise<Args...>* Then(const FullFilledCallback& callback) {
-			_onresolve.push_back(callback);
-			return this;
+		void Fail(std::shared_ptr<Error> error) {
+			int expected = kPending;
+
+			if (_state.compare_exchange_strong(expected, kSettling, std::memory_order_acquire)) {
+				_error = std::move(error);
+				_state.store(kRejected, std::memory_order_release);
+				Dispatch();
+			}
+		}
+
+		template <typename P> void Pipe(const std::shared_ptr<P>& next) {
+			AddContinuation([this, next]() {
+				if (_state.load(std::memory_order_acquire) == kRejected) {
+					next->Fail(_error);
+				}
+				else {
+					std::apply([&next](Args&... args) { next->Fulfill(args...); }, *_value);
+				}
+			}, true);
 		}
 
-		inline Promise<Args...>* Catch(const RejectedCallback& callback) {
-			_onreject.push_back(callback);
-			return this;
+		void AddContinuation(Task task, bool direct = false) {
+			Node* node = _first_claimed.test_and_set(std::memory_order_relaxed) ? new Node() : &_first;
+			uintptr_t head = _head.load(std::memory_order_acquire);
+
+			node->task = std::move(task);
+			node->direct = direct;
+
+			do {
+				if (head == kDone) {
+					// Running inline would overtake continuations registered earlier and still queued on the executor.
+					if (direct || (_executor->IsCurrent() && !_posted.load(std::memory_order_acquire))) {
+						node->task();
+						Release(node, false);
+					}
+					else {
+						node->next = nullptr;
+						Post(node);
+					}
+
+					return;
+				}
+
+				node->next = reinterpret_cast<Node*>(head);
+			} while (!_head.compare_exchange_weak(head, reinterpret_cast<uintptr_t>(node), std::memory_order_release, std::memory_order_acquire));
 		}
 
-		inline Promise<Args...>* Finally(const FinallyCallback& callback) {
-			_onfinally.push_back(callback);
-			return this;
+		void Dispatch() {
+			Node* head = reinterpret_cast<Node*>(_head.exchange(kDone, std::memory_order_acq_rel));
+			Node* deferred = nullptr;
+
+			// The list is LIFO, reversing it restores registration order.
+			while (head) {
+				Node* node = head;
+				head = node->next;
+
+				if (node->direct) {
+					// Direct continuations only forward state and wake waiters, they are run right here.
+					node->next = nullptr;
+					node->task();
+					Release(node, false);
+				}
+				else {
+					node->next = deferred;
+					deferred = node;
+				}
+			}
+
+			if (!deferred) {
+				return;
+			}
+
+			if (_executor->IsCurrent()) {
+				Continuations(this->shared_from_this(), deferred)();
+			}
+			else {
+				Post(deferred);
+			}
 		}
 
-		inline Promise<Args...>* WaitForResult() {
-			std::unique_lock<std::mutex> lk(_mtx);
-			_cnd.wait(lk, [=] { return _completed; });
-			return this;
+		void Post(Node* head) {
+			_posted.fetch_add(1, std::memory_order_acq_rel);
+			Async::Call(_executor, Continuations(this->shared_from_this(), head, true));
 		}
 
-	private:
-		std::condition_variable _cnd;
-		std::mutex _mtx;
-		bool _completed;
+		void Release(Node* node, bool list = true) {
+			while (node) {
+				Node* next = list ? node->next : nullptr;
+
+				if (node == &_first) {
+					node->task.Reset();
+				}
+				else {
+					delete node;
+				}
+
+				node = next;
+			}
+		}
 
-		std::vector<FullFilledCallback> _onresolve;
-		std::vector<RejectedCallback> _onreject;
-		std::vector<FinallyCallback> _onfinally;
+		std::shared_ptr<Executor> _executor;
+		std::atomic<int> _state;
+		std::atomic<uintptr_t> _head;
+		// Continuation lists posted to the executor that have not run yet.
+		std::atomic<int> _posted;
+		std::atomic_flag _first_claimed = ATOMIC_FLAG_INIT;
+		std::optional<std::tuple<Args...>> _value;
+		std::shared_ptr<Error> _error;
+		Node _first;
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,778 @@
+#include "recorder.h"
+#include "event.h"
+#include "rtc_base/helpers.h"
+#include "rtc_base/logging.h"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <thread>
+
+#if defined(_WIN32)
+	#include <fcntl.h>
+	#include <io.h>
+	#include <malloc.h>
+	#include <sys/stat.h>
+#else
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+using namespace crtc;
+
+namespace {
+	// O_DIRECT wants buffers, sizes and offsets aligned to the logical block size, 4096 covers every common disk.
+	const size_t kAlignment = 4096;
+
+	// About a second of 20 ms Opus packets per Ogg page.
+	const size_t kPacketsPerPage = 50;
+
+	const uint8_t kBeginOfStream = 0x02;
+	const uint8_t kEndOfStream = 0x04;
+
+	uint8_t* AllocateAligned(size_t size) {
+#if defined(_WIN32)
+		return static_cast<uint8_t*>(_aligned_malloc(size, kAlignment));
+#else
+		void* buffer = nullptr;
+		return posix_memalign(&buffer, kAlignment, size) ? nullptr : static_cast<uint8_t*>(buffer);
+#endif
+	}
+
+	void FreeAligned(uint8_t* buffer) {
+#if defined(_WIN32)
+		_aligned_free(buffer);
+#else
+		free(buffer);
+#endif
+	}
+
+	// Falls back to buffered writes on file systems refusing O_DIRECT.
+	int OpenFile(const char* path, bool direct, bool* opened_direct) {
+		*opened_direct = false;
+
+#if defined(_WIN32)
+		(void)direct;
+		return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#ifdef O_DIRECT
+		if (direct) {
+			int fd = open(path, flags | O_DIRECT, 0644);
+
+			if (fd >= 0) {
+				*opened_direct = true;
+				return fd;
+			}
+		}
+#else
+		(void)direct;
+#endif
+
+		return open(path, flags, 0644);
+#endif
+	}
+
+	// The tail of a file is not a whole block, it and the header patches are written through the page cache.
+	void DisableDirect(int fd) {
+#if defined(O_DIRECT) && !defined(_WIN32)
+		int flags = fcntl(fd, F_GETFL);
+
+		if (flags >= 0) {
+			fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+		}
+#else
+		(void)fd;
+#endif
+	}
+
+	bool WriteAll(int fd, const uint8_t* data, size_t length) {
+		while (length) {
+#if defined(_WIN32)
+			int written = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(length, 1 << 30)));
+#else
+			ssize_t written = write(fd, data, length);
+
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+#endif
+
+			if (written <= 0) {
+				return false;
+			}
+
+			data += written;
+			length -= written;
+		}
+
+		return true;
+	}
+
+	bool WriteAt(int fd, uint64_t offset, const uint8_t* data, size_t length) {
+#if defined(_WIN32)
+		return _lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) >= 0 && WriteAll(fd, data, length);
+#else
+		return pwrite(fd, data, length, static_cast<off_t>(offset)) == static_cast<ssize_t>(length);
+#endif
+	}
+
+	void CloseFile(int fd) {
+#if defined(_WIN32)
+		_close(fd);
+#else
+		close(fd);
+#endif
+	}
+
+	void Put16(uint8_t* out, uint16_t value) {
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+	}
+
+	void Put32(uint8_t* out, uint32_t value) {
+		Put16(out, static_cast<uint16_t>(value));
+		Put16(out + 2, static_cast<uint16_t>(value >> 16));
+	}
+
+	void Put64(uint8_t* out, uint64_t value) {
+		Put32(out, static_cast<uint32_t>(value));
+		Put32(out + 4, static_cast<uint32_t>(value >> 32));
+	}
+
+	// CRC-32 of Ogg pages, polynomial 0x04C11DB7 without reflection.
+	uint32_t OggCrc(const uint8_t* data, size_t length, uint32_t crc = 0) {
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> values;
+
+			for (uint32_t index = 0; index < 256; index++) {
+				uint32_t value = index << 24;
+
+				for (int bit = 0; bit < 8; bit++) {
+					value = (value & 0x80000000) ? (value << 1) ^ 0x04C11DB7 : (value << 1);
+				}
+
+				values[index] = value;
+			}
+
+			return values;
+		}();
+
+		for (size_t index = 0; index < length; index++) {
+			crc = (crc << 8) ^ table[((crc >> 24) ^ data[index]) & 0xFF];
+		}
+
+		return crc;
+	}
+
+	// Samples at 48 kHz in an Opus packet, from its TOC byte (RFC 6716, section 3.1).
+	int64_t OpusSamples(const uint8_t* data, size_t length) {
+		if (!length) {
+			return 0;
+		}
+
+		int config = data[0] >> 3;
+		int64_t frameSize;
+
+		if (config < 12) {
+			static const int64_t silk[] = { 480, 960, 1920, 2880 };
+			frameSize = silk[config & 3];
+		}
+		else if (config < 16) {
+			frameSize = (config & 1) ? 960 : 480;
+		}
+		else {
+			static const int64_t celt[] = { 120, 240, 480, 960 };
+			frameSize = celt[config & 3];
+		}
+
+		switch (data[0] & 3) {
+			case 0:
+				return frameSize;
+			case 3:
+				return (length > 1) ? frameSize * (data[1] & 0x3F) : 0;
+			default:
+				return frameSize * 2;
+		}
+	}
+
+	void Lace(std::vector<uint8_t>& segments, size_t length) {
+		segments.insert(segments.end(), length / 255, 255);
+		segments.push_back(static_cast<uint8_t>(length % 255));
+	}
+
+	// The single thread writing every recording, so a slow disk never holds up the threads receiving media.
+	class Writer {
+	public:
+		static Writer& Instance() {
+			static Writer writer;
+			return writer;
+		}
+
+		void Post(std::function<void()> job) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_jobs.push_back(std::move(job));
+			}
+
+			_cnd.notify_one();
+		}
+
+	private:
+		Writer() :
+			_stopping(false),
+			_thread(&Writer::Run, this)
+		{ }
+
+		~Writer() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+
+			_cnd.notify_one();
+			_thread.join();
+		}
+
+		void Run() {
+			std::deque<std::function<void()>> jobs;
+
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_cnd.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+
+					if (_jobs.empty()) {
+						return;
+					}
+
+					jobs.swap(_jobs);
+				}
+
+				while (!jobs.empty()) {
+					jobs.front()();
+					jobs.pop_front();
+				}
+			}
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _cnd;
+		std::deque<std::function<void()>> _jobs;
+		bool _stopping;
+		std::thread _thread;
+	};
+}
+
+namespace crtc {
+	// Collects appended bytes into aligned buffers of bufferSize, each full one is written by the writer thread.
+	class RecordingFile : public std::enable_shared_from_this<RecordingFile> {
+	public:
+		RecordingFile(int fd, size_t bufferSize, bool direct, std::shared_ptr<RecordingState> state, size_t maxQueued) :
+			_fd(fd),
+			_buffer_size(bufferSize),
+			_direct(direct),
+			_state(std::move(state)),
+			_max_queued(maxQueued),
+			_failed(false),
+			_buffer(nullptr),
+			_used(0)
+		{ }
+
+		~RecordingFile() {
+			if (_fd >= 0) {
+				CloseFile(_fd);
+			}
+
+			FreeAligned(_buffer);
+
+			for (uint8_t* buffer : _free) {
+				FreeAligned(buffer);
+			}
+		}
+
+		// Appends both parts or nothing. Fails while the recorder has maxQueued bytes waiting or after a write failed.
+		bool Append(const uint8_t* header, size_t headerLength, const uint8_t* data = nullptr, size_t length = 0) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (_failed.load(std::memory_order_relaxed) || _state->queued.load(std::memory_order_relaxed) + headerLength + length > _max_queued) {
+				return false;
+			}
+
+			return Copy(header, headerLength) && Copy(data, length);
+		}
+
+		// Queues what is buffered and the patches, then closes the file. closed is released once it is.
+		void Close(std::vector<std::pair<uint64_t, std::vector<uint8_t>>> patches, std::shared_ptr<void> closed) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			uint8_t* tail = _buffer;
+			size_t used = _used;
+
+			_buffer = nullptr;
+			_used = 0;
+			_state->queued.fetch_add(used, std::memory_order_relaxed);
+
+			auto self = shared_from_this();
+
+			Writer::Instance().Post([self, tail, used, patches = std::move(patches), closed = std::move(closed)]() {
+				if (self->_direct) {
+					DisableDirect(self->_fd);
+				}
+
+				if (tail) {
+					self->Write(tail, used);
+				}
+
+				for (const auto& patch : patches) {
+					if (!self->_failed && !WriteAt(self->_fd, patch.first, patch.second.data(), patch.second.size())) {
+						self->Fail();
+					}
+				}
+
+				CloseFile(self->_fd);
+				self->_fd = -1;
+			});
+		}
+
+	private:
+		bool Copy(const uint8_t* data, size_t length) {
+			while (length) {
+				if (!_buffer) {
+					if (!_free.empty()) {
+						_buffer = _free.back();
+						_free.pop_back();
+					}
+					else if (!(_buffer = AllocateAligned(_buffer_size))) {
+						return false;
+					}
+				}
+
+				size_t copy = std::min(length, _buffer_size - _used);
+
+				memcpy(_buffer + _used, data, copy);
+				_used += copy;
+				data += copy;
+				length -= copy;
+
+				if (_used == _buffer_size) {
+					Submit();
+				}
+			}
+
+			return true;
+		}
+
+		void Submit() {
+			uint8_t* buffer = _buffer;
+			size_t used = _used;
+			auto self = shared_from_this();
+
+			_buffer = nullptr;
+			_used = 0;
+			_state->queued.fetch_add(used, std::memory_order_relaxed);
+
+			Writer::Instance().Post([self, buffer, used]() {
+				self->Write(buffer, used);
+			});
+		}
+
+		// On the writer thread.
+		void Write(uint8_t* buffer, size_t length) {
+			if (!_failed.load(std::memory_order_relaxed)) {
+				if (WriteAll(_fd, buffer, length)) {
+					_state->written.fetch_add(length, std::memory_order_relaxed);
+				}
+				else {
+					Fail();
+				}
+			}
+
+			_state->queued.fetch_sub(length, std::memory_order_relaxed);
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_free.push_back(buffer);
+		}
+
+		void Fail() {
+			_failed.store(true, std::memory_order_relaxed);
+			_state->Fail(Error::New("Failed to write recording", __FILE__, __LINE__));
+		}
+
+		int _fd;
+		size_t _buffer_size;
+		bool _direct;
+		std::shared_ptr<RecordingState> _state;
+		size_t _max_queued;
+		std::atomic<bool> _failed;
+
+		std::mutex _mutex;
+		uint8_t* _buffer;
+		size_t _used;
+		std::vector<uint8_t*> _free;
+	};
+}
+
+void RecordingState::Fail(std::shared_ptr<Error> failure) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!error) {
+		error = std::move(failure);
+	}
+}
+
+std::shared_ptr<RTCRecorderInternal> RTCRecorderInternal::New(const RTCPeerConnection::RTCRecorderOptions& options, std::shared_ptr<Executor> executor) {
+	auto recorder = std::make_shared<RTCRecorderInternal>(std::move(executor));
+	size_t bufferSize = std::max(kAlignment, (options.bufferSize + kAlignment - 1) / kAlignment * kAlignment);
+
+	auto open = [&](const String& path) -> std::shared_ptr<RecordingFile> {
+		bool direct = false;
+		int fd = OpenFile(path.c_str(), options.directIO, &direct);
+
+		if (fd < 0) {
+			RTC_LOG(LS_ERROR) << "Failed to create recording " << path.c_str();
+			return nullptr;
+		}
+
+		return std::make_shared<RecordingFile>(fd, bufferSize, direct, recorder->_state, options.maxQueuedBytes);
+	};
+
+	if (*options.videoPath.c_str() && !(recorder->_video = open(options.videoPath))) {
+		return nullptr;
+	}
+
+	if (*options.audioPath.c_str() && !(recorder->_audio = open(options.audioPath))) {
+		return nullptr;
+	}
+
+	if (!recorder->_video && !recorder->_audio) {
+		return nullptr;
+	}
+
+	return recorder;
+}
+
+RTCRecorderInternal::RTCRecorderInternal(std::shared_ptr<Executor> executor) :
+	_executor(std::move(executor)),
+	_state(std::make_shared<RecordingState>()),
+	_stopped(false),
+	_video_codec(webrtc::kVideoCodecGeneric),
+	_ivf(false),
+	_waiting_for_key_frame(true),
+	_mismatch_logged(false),
+	_frames(0),
+	_width(0),
+	_height(0),
+	_video_start(0),
+	_audio_started(false),
+	_serial(rtc::CreateRandomId()),
+	_page(0),
+	_page_packets(0),
+	_granule(0),
+	_audio_start(0)
+{ }
+
+RTCRecorderInternal::~RTCRecorderInternal() {
+	Stop();
+}
+
+bool RTCRecorderInternal::RecordsVideo() const {
+	std::lock_guard<std::mutex> lock(_video_mutex);
+	return _video != nullptr;
+}
+
+bool RTCRecorderInternal::RecordsAudio() const {
+	std::lock_guard<std::mutex> lock(_audio_mutex);
+	return _audio != nullptr;
+}
+
+void RTCRecorderInternal::PushVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec) {
+	bool keyFrame = image._frameType == webrtc::VideoFrameType::kVideoFrameKey;
+	std::lock_guard<std::mutex> lock(_video_mutex);
+
+	if (!_video) {
+		return;
+	}
+
+	// Frames after a dropped one can't be decoded.
+	if (_waiting_for_key_frame && !keyFrame) {
+		_state->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	if (_video_codec == webrtc::kVideoCodecGeneric) {
+		if (!WriteVideoHeader(image, codec)) {
+			_state->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+	else if (codec != _video_codec) {
+		if (!_mismatch_logged) {
+			RTC_LOG(LS_WARNING) << "Recording dropped frames of a second video codec";
+			_mismatch_logged = true;
+		}
+
+		_state->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	bool written;
+
+	if (_ivf) {
+		uint8_t header[14];
+		size_t headerLength = 12;
+
+		// AV1 temporal units start with a temporal delimiter, RTP leaves it out.
+		if (_video_codec == webrtc::kVideoCodecAV1) {
+			header[12] = 0x12;
+			header[13] = 0;
+			headerLength = 14;
+		}
+
+		Put32(header, static_cast<uint32_t>(image.size() + headerLength - 12));
+		Put64(header + 4, static_cast<uint64_t>(_video_unwrapper.Unwrap(image.RtpTimestamp()) - _video_start));
+
+		written = _video->Append(header, headerLength, image.data(), image.size());
+	}
+	else {
+		written = _video->Append(image.data(), image.size());
+	}
+
+	if (!written) {
+		_waiting_for_key_frame = true;
+		_state->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	_waiting_for_key_frame = false;
+	_frames++;
+}
+
+void RTCRecorderInternal::PushAudio(const uint8_t* data, size_t length, uint32_t timestamp, size_t channels) {
+	std::lock_guard<std::mutex> lock(_audio_mutex);
+
+	if (!_audio || !length) {
+		return;
+	}
+
+	if (!_audio_started) {
+		if (!WriteAudioHeader(channels)) {
+			_state->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		_audio_start = _audio_unwrapper.Unwrap(timestamp);
+	}
+
+	// Opus runs a 48 kHz RTP clock, the granule position counts 48 kHz samples as well.
+	int64_t end = _audio_unwrapper.Unwrap(timestamp) - _audio_start + OpusSamples(data, length);
+
+	if (_segments.size() + length / 255 + 1 > 255) {
+		FlushPage(0);
+	}
+
+	Lace(_segments, length);
+	_packets.insert(_packets.end(), data, data + length);
+	_granule = std::max(_granule, end);
+
+	if (++_page_packets >= kPacketsPerPage) {
+		FlushPage(0);
+	}
+}
+
+uint64_t RTCRecorderInternal::BytesWritten() const {
+	return _state->written.load(std::memory_order_relaxed);
+}
+
+uint64_t RTCRecorderInternal::FramesDropped() const {
+	return _state->dropped.load(std::memory_order_relaxed);
+}
+
+void RTCRecorderInternal::Stop(std::function<void(std::shared_ptr<Error>)> callback) {
+	// Released by the files once they are closed, then runs the callback.
+	std::shared_ptr<void> closed(nullptr, [executor = _executor, state = _state, callback, event = Event::New()](void*) {
+		if (!callback) {
+			return;
+		}
+
+		std::shared_ptr<Error> error;
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			error = state->error;
+		}
+
+		Async::Call(executor, [callback, error, event]() {
+			callback(error);
+		});
+	});
+
+	if (_stopped.exchange(true)) {
+		return;
+	}
+
+	std::shared_ptr<RecordingFile> video;
+	std::shared_ptr<RecordingFile> audio;
+	std::vector<std::pair<uint64_t, std::vector<uint8_t>>> patches;
+
+	{
+		std::lock_guard<std::mutex> lock(_video_mutex);
+		video = std::move(_video);
+
+		if (_ivf) {
+			std::vector<uint8_t> frames(4);
+			Put32(frames.data(), _frames);
+			patches.emplace_back(24, std::move(frames));
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_audio_mutex);
+
+		if (_audio && _audio_started) {
+			FlushPage(kEndOfStream);
+		}
+
+		audio = std::move(_audio);
+	}
+
+	if (video) {
+		video->Close(std::move(patches), closed);
+	}
+
+	if (audio) {
+		audio->Close({}, closed);
+	}
+}
+
+bool RTCRecorderInternal::WriteVideoHeader(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec) {
+	const char* fourcc = nullptr;
+
+	switch (codec) {
+		case webrtc::kVideoCodecVP8:
+			fourcc = "VP80";
+			break;
+		case webrtc::kVideoCodecVP9:
+			fourcc = "VP90";
+			break;
+		case webrtc::kVideoCodecAV1:
+			fourcc = "AV01";
+			break;
+		case webrtc::kVideoCodecH264:
+			break;
+		default:
+			if (!_mismatch_logged) {
+				RTC_LOG(LS_WARNING) << "Recording does not support video codec " << static_cast<int>(codec);
+				_mismatch_logged = true;
+			}
+
+			return false;
+	}
+
+	_ivf = fourcc != nullptr;
+	_video_start = _video_unwrapper.Unwrap(image.RtpTimestamp());
+
+	if (_ivf) {
+		uint8_t header[32] = { 0 };
+
+		_width = static_cast<uint16_t>(image._encodedWidth);
+		_height = static_cast<uint16_t>(image._encodedHeight);
+
+		memcpy(header, "DKIF", 4);
+		Put16(header + 6, static_cast<uint16_t>(sizeof(header)));
+		memcpy(header + 8, fourcc, 4);
+		Put16(header + 12, _width);
+		Put16(header + 14, _height);
+		Put32(header + 16, 90000);
+		Put32(header + 20, 1);
+
+		// The frame count at offset 24 is written by Stop().
+		if (!_video->Append(header, sizeof(header))) {
+			_ivf = false;
+			return false;
+		}
+	}
+
+	_video_codec = codec;
+	return true;
+}
+
+bool RTCRecorderInternal::WriteAudioHeader(size_t channels) {
+	uint8_t head[19] = { 0 };
+
+	memcpy(head, "OpusHead", 8);
+	head[8] = 1;
+	head[9] = static_cast<uint8_t>(std::max<size_t>(1, std::min<size_t>(channels, 2)));
+	Put32(head + 12, 48000);
+
+	static const char vendor[] = "libcrtc";
+	uint8_t tags[8 + 4 + sizeof(vendor) - 1 + 4] = { 0 };
+
+	memcpy(tags, "OpusTags", 8);
+	Put32(tags + 8, sizeof(vendor) - 1);
+	memcpy(tags + 12, vendor, sizeof(vendor) - 1);
+
+	_page = 0;
+	_granule = 0;
+
+	// Each header packet gets a page of its own.
+	Lace(_segments, sizeof(head));
+	_packets.assign(head, head + sizeof(head));
+
+	if (!FlushPage(kBeginOfStream)) {
+		return false;
+	}
+
+	Lace(_segments, sizeof(tags));
+	_packets.assign(tags, tags + sizeof(tags));
+
+	if (!FlushPage(0)) {
+		return false;
+	}
+
+	_audio_started = true;
+	return true;
+}
+
+bool RTCRecorderInternal::FlushPage(uint8_t flags) {
+	if (_segments.empty() && !(flags & kEndOfStream)) {
+		return true;
+	}
+
+	uint8_t header[27 + 255];
+	size_t headerLength = 27 + _segments.size();
+
+	memcpy(header, "OggS", 4);
+	header[4] = 0;
+	header[5] = flags;
+	Put64(header + 6, static_cast<uint64_t>(_granule));
+	Put32(header + 14, _serial);
+	Put32(header + 18, _page++);
+	Put32(header + 22, 0);
+	header[26] = static_cast<uint8_t>(_segments.size());
+
+	if (!_segments.empty()) {
+		memcpy(header + 27, _segments.data(), _segments.size());
+	}
+
+	uint32_t crc = OggCrc(header, headerLength);
+	crc = OggCrc(_packets.data(), _packets.size(), crc);
+	Put32(header + 22, crc);
+
+	bool written = _audio->Append(header, headerLength, _packets.data(), _packets.size());
+
+	if (!written) {
+		_state->dropped.fetch_add(_page_packets, std::memory_order_relaxed);
+	}
+
+	_segments.clear();
+	_packets.clear();
+	_page_packets = 0;
+
+	return written;
+}
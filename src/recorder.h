@@ -0,0 +1,81 @@
+#ifndef CRTC_RECORDER_H
+#define CRTC_RECORDER_H
+
+#include "crtc.h"
+#include "api/video/encoded_image.h"
+#include "api/video/video_codec_type.h"
+#include "rtc_base/numerics/sequence_number_unwrapper.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace crtc {
+	class RecordingFile;
+
+	// Counters and the first error, shared with the files of a recorder.
+	struct RecordingState {
+		std::atomic<uint64_t> queued{ 0 };
+		std::atomic<uint64_t> written{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+
+		std::mutex mutex;
+		std::shared_ptr<Error> error;
+
+		void Fail(std::shared_ptr<Error> failure);
+	};
+
+	// Muxes the streams handed over by the bypass decoders. Video is written as IVF or Annex B, audio as Ogg Opus.
+	class RTCRecorderInternal : public RTCPeerConnection::RTCRecorder {
+	public:
+		static std::shared_ptr<RTCRecorderInternal> New(const RTCPeerConnection::RTCRecorderOptions& options, std::shared_ptr<Executor> executor);
+
+		explicit RTCRecorderInternal(std::shared_ptr<Executor> executor);
+		~RTCRecorderInternal() override;
+
+		bool RecordsVideo() const;
+		bool RecordsAudio() const;
+
+		// Called on the threads decoding the streams.
+		void PushVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec);
+		void PushAudio(const uint8_t* data, size_t length, uint32_t timestamp, size_t channels);
+
+		uint64_t BytesWritten() const override;
+		uint64_t FramesDropped() const override;
+		void Stop(std::function<void(std::shared_ptr<Error>)> callback = nullptr) override;
+
+	private:
+		bool WriteVideoHeader(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec);
+		bool WriteAudioHeader(size_t channels);
+		bool FlushPage(uint8_t flags);
+
+		std::shared_ptr<Executor> _executor;
+		std::shared_ptr<RecordingState> _state;
+		std::atomic<bool> _stopped;
+
+		mutable std::mutex _video_mutex;
+		std::shared_ptr<RecordingFile> _video;
+		webrtc::VideoCodecType _video_codec;
+		bool _ivf;
+		bool _waiting_for_key_frame;
+		bool _mismatch_logged;
+		uint32_t _frames;
+		uint16_t _width;
+		uint16_t _height;
+		webrtc::RtpTimestampUnwrapper _video_unwrapper;
+		int64_t _video_start;
+
+		mutable std::mutex _audio_mutex;
+		std::shared_ptr<RecordingFile> _audio;
+		bool _audio_started;
+		uint32_t _serial;
+		uint32_t _page;
+		std::vector<uint8_t> _segments;
+		std::vector<uint8_t> _packets;
+		size_t _page_packets;
+		int64_t _granule;
+		webrtc::RtpTimestampUnwrapper _audio_unwrapper;
+		int64_t _audio_start;
+	};
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "rtccertificate.h"
+#include "peerconnectionpool.h"
+#include <rtc_base/rtc_certificate_generator.h>
+
+using namespace crtc;
+
+RTCCertificateInternal::RTCCertificateInternal(rtc::scoped_refptr<rtc::RTCCertificate> certificate) :
+	_certificate(std::move(certificate))
+{ }
+
+RTCCertificateInternal::~RTCCertificateInternal() {
+
+}
+
+uint64_t RTCCertificateInternal::Expires() const {
+	return _certificate->Expires();
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate> RTCCertificateInternal::Certificate() const {
+	return _certificate;
+}
+
+void RTCPeerConnection::GenerateCertificate(std::function<void(std::shared_ptr<Error>, std::shared_ptr<RTCCertificate>)> callback, RTCCertificate::KeyType keyType, uint64_t expiresMs) {
+	auto executor = Executor::Current();
+
+	// RSA keys take hundreds of milliseconds, never generate them on the caller's thread.
+	PeerConnectionPool::BackgroundExecutor()->Post([callback = std::move(callback), executor, keyType, expiresMs]() mutable {
+		rtc::KeyParams params = (keyType == RTCCertificate::kRSA) ? rtc::KeyParams::RSA() : rtc::KeyParams::ECDSA();
+		absl::optional<uint64_t> expires;
+
+		if (expiresMs) {
+			expires = expiresMs;
+		}
+
+		auto certificate = rtc::RTCCertificateGenerator::GenerateCertificate(params, expires);
+
+		Async::Call(executor, [callback = std::move(callback), certificate]() {
+			if (!callback) {
+				return;
+			}
+
+			if (certificate) {
+				callback(nullptr, std::make_shared<RTCCertificateInternal>(certificate));
+			}
+			else {
+				callback(Error::New("Unable to generate certificate", __FILE__, __LINE__), nullptr);
+			}
+		});
+	});
+}
@@ -0,0 +1,22 @@
+#ifndef CRTC_RTCCERTIFICATE_H
+#define CRTC_RTCCERTIFICATE_H
+
+#include "crtc.h"
+#include <rtc_base/rtc_certificate.h>
+
+namespace crtc {
+	class RTCCertificateInternal : public RTCPeerConnection::RTCCertificate {
+	public:
+		explicit RTCCertificateInternal(rtc::scoped_refptr<rtc::RTCCertificate> certificate);
+		~RTCCertificateInternal() override;
+
+		uint64_t Expires() const override;
+
+		rtc::scoped_refptr<rtc::RTCCertificate> Certificate() const;
+
+	private:
+		rtc::scoped_refptr<rtc::RTCCertificate> _certificate;
+	};
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "crtc.h"
 #include "rtcdatachannel.h"
 #include "arraybuffer.h"
+#include "metrics.h"
 
 using namespace crtc;
 
@@ -109,6 +110,8 @@ void RTCDataChannelInternal::Send(const std::shared_ptr<ArrayBuffer>& data, bool
 	webrtc::DataBuffer dataBuffer(buffer, binary);
 
 	if (!_channel->Send(dataBuffer)) {
+		MetricsRegistry::Add(MetricsRegistry::kDataChannelSendFailures);
+
 		switch (_channel->state()) {
 		case webrtc::DataChannelInterface::kConnecting:
 			_onerror(Error::New("Unable to send arraybuffer. DataChannel is connecting", __FILE__, __LINE__));
@@ -131,6 +134,8 @@ void RTCDataChannelInternal::Send(const unsigned char* data, size_t length, bool
 	webrtc::DataBuffer dataBuffer(buffer, binary);
 
 	if (!_channel->Send(dataBuffer)) {
+		MetricsRegistry::Add(MetricsRegistry::kDataChannelSendFailures);
+
 		switch (_channel->state()) {
 		case webrtc::DataChannelInterface::kConnecting:
 			_onerror(Error::New("Unable to send arraybuffer. DataChannel is connecting", __FILE__, __LINE__));
@@ -25,31 +25,74 @@
 
 #include "rtcpeerconnection.h"
 #include "rtcdatachannel.h"
+#include "rtcrtpsender.h"
+#include "rtcrtptransceiver.h"
 #include "mediastream.h"
 #include "customaudiofactory.h"
 #include "customvideofactory.h"
+#include "customvideoencoderfactory.h"
+#include "decodeswitch.h"
+#include "recorder.h"
+#include "videorelay.h"
 #include "api/audio_codecs/builtin_audio_decoder_factory.h"
 #include "api/audio_codecs/builtin_audio_encoder_factory.h"
 #include "api/video_codecs/video_decoder_factory.h"
 #include "api/video_codecs/video_decoder_factory_template.h"
 #include "api/video_codecs/video_decoder_factory_template_open_h264_adapter.h"
-#include "api/video_codecs/video_encoder_factory.h"
-#include "api/video_codecs/video_encoder_factory_template.h"
-#include "api/video_codecs/video_encoder_factory_template_open_h264_adapter.h"
+#include "absl/strings/match.h"
+#include "rtc_base/helpers.h"
 #include "rtc_base/logging.h"
 #include "fakeaudiodevice.h"
-#ifdef __ANDROID__
-#include <unistd.h>
-#endif
+#include "peerconnectionpool.h"
 
 using namespace crtc;
 
-RTCPeerConnectionInternal::RTCPeerConnectionInternal() {
-	webrtc::PeerConnectionInterface::RTCConfiguration cfg(webrtc::PeerConnectionInterface::RTCConfigurationType::kAggressive);
+namespace {
+	// Everything a destroyed connection owned. Released in dependency order: the PeerConnection and
+	// the factory need the signaling thread, the threads go last.
+	struct Teardown {
+		rtc::scoped_refptr<webrtc::PeerConnectionInterface> socket;
+		rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+		std::unique_ptr<rtc::Thread> signal_thread;
+		std::unique_ptr<rtc::Thread> worker_thread;
+		std::unique_ptr<rtc::Thread> network_thread;
+		std::unique_ptr<webrtc::TaskQueueFactory> task_queue;
+
+		void operator()() {
+			socket = nullptr;
+			factory = nullptr;
+			signal_thread.reset();
+			worker_thread.reset();
+			network_thread.reset();
+			task_queue.reset();
+		}
+	};
 
-	_settingLocalDesc = _settingRemoteDesc = false;
+	webrtc::RtpTransceiverInit TransceiverInit(const RTCPeerConnection::RTCRtpTransceiverInit& init, bool video) {
+		webrtc::RtpTransceiverInit result;
 
-	_task_queue = webrtc::CreateDefaultTaskQueueFactory();
+		result.direction = RTCRtpTransceiverInternal::ToDirection(init.direction);
+		result.send_encodings = RTCRtpSenderInternal::ToEncodings(init.sendEncodings, video);
+
+		for (const auto& id : init.streamIds) {
+			result.stream_ids.push_back(id.c_str());
+		}
+
+		return result;
+	}
+
+	std::shared_ptr<Executor> TeardownExecutor() {
+		static std::shared_ptr<Executor> executor = Executor::NewLoop("teardown");
+		return executor;
+	}
+}
+
+RTCPeerConnectionInternal::RTCPeerConnectionInternal(bool dataChannelsOnly) : _video_encoder_factory(nullptr), _data_only(dataChannelsOnly), _raw_video(false), _raw_audio(false) {
+	webrtc::PeerConnectionInterface::RTCConfiguration cfg(webrtc::PeerConnectionInterface::RTCConfigurationType::kAggressive);
+
+	_operations = std::make_shared<Operations>();
+	_operations->pc = this;
+	_operations->executor = Executor::Default();
 
 	_network_thread = rtc::Thread::CreateWithSocketServer();
 	_network_thread->SetName("network", nullptr);
@@ -65,6 +108,24 @@ RTCPeerConnectionInternal::RTCPeerConnectionInternal() {
 		rtc::webrtc_logging_impl::LogCall();
 	}
 
+	_operations->thread = _signal_thread.get();
+
+	if (_data_only) {
+		// Without media the worker thread only relays SCTP state, the network thread does that as well.
+		webrtc::PeerConnectionFactoryDependencies dependencies;
+
+		dependencies.network_thread = _network_thread.get();
+		dependencies.worker_thread = _network_thread.get();
+		dependencies.signaling_thread = _signal_thread.get();
+		dependencies.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+
+		// No EnableMedia(), the factory is built without audio device, codecs or media engine.
+		_factory = webrtc::CreateModularPeerConnectionFactory(std::move(dependencies));
+		return;
+	}
+
+	_task_queue = webrtc::CreateDefaultTaskQueueFactory();
+
 	_worker_thread = rtc::Thread::Create();
 	_worker_thread->SetName("worker", nullptr);
 
@@ -79,6 +140,9 @@ RTCPeerConnectionInternal::RTCPeerConnectionInternal() {
 	//	audio_device->Init();
 	//}
 
+	auto video_encoder_factory = std::make_unique<CustomVideoEncoderFactory>();
+	_video_encoder_factory = video_encoder_factory.get();
+
 	_factory = webrtc::CreatePeerConnectionFactory(
 		_network_thread.get(),
 		_worker_thread.get(),
@@ -86,7 +150,7 @@ RTCPeerConnectionInternal::RTCPeerConnectionInternal() {
 		audio_device,
 		webrtc::CreateBuiltinAudioEncoderFactory(),
 		rtc::make_ref_counted<CustomAudioFactory>(this),
-		std::make_unique<webrtc::VideoEncoderFactoryTemplate<webrtc::OpenH264EncoderTemplateAdapter>>(),
+		std::move(video_encoder_factory),
 		std::make_unique<CustomVideoFactory>(this),
 		nullptr, //rtc::scoped_refptr<AudioMixer> audio_mixer,
 		nullptr, //rtc::scoped_refptr<AudioProcessing> audio_processing,
@@ -95,25 +159,58 @@ RTCPeerConnectionInternal::RTCPeerConnectionInternal() {
 }
 
 RTCPeerConnectionInternal::~RTCPeerConnectionInternal() {
-	if (_socket && _socket->signaling_state() != webrtc::PeerConnectionInterface::kClosed) {
-		_socket->Close();
-	}
+	StopRecorder();
 
 	for (const auto& s : _streams)
 	{
 		s->ClearObserver();
 	}
 
-	//Process any remaining events before we delete
-	while (Module::DispatchEvents(false) || _settingRemoteDesc || _settingRemoteDesc) {
-#ifdef __ANDROID__
-		sleep(1);
-#else
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-#endif
-	}
+	// Tasks posted to the signaling thread capture this, running behind them guarantees they are done.
+	// Observers still held by WebRTC see a detached connection from here on.
+	_signal_thread->BlockingCall([this]() {
+		if (_socket && _socket->signaling_state() != webrtc::PeerConnectionInterface::kClosed) {
+			_socket->Close();
+		}
+
+		FailPendingIceCandidates(Error::New("RTCPeerConnection closed before the candidates were applied", __FILE__, __LINE__));
+
+		std::lock_guard<std::mutex> lock(_operations->mutex);
+
+		_operations->pc = nullptr;
+		_operations->thread = nullptr;
+	});
 
 	_streams.clear();
+
+	// Released ahead of the threads the remote tracks of the switches call into, outside of the mutex.
+	{
+		rtc::scoped_refptr<VideoRelaySource> relaySource;
+		std::shared_ptr<MediaStreamTrack> relayTrack;
+		std::map<uint32_t, std::shared_ptr<DecodeSwitch>> videoSsrcs;
+		std::vector<std::shared_ptr<DecodeSwitch>> videoSwitches;
+		std::vector<std::shared_ptr<DecodeSwitch>> audioSwitches;
+
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+		relaySource.swap(_relay_source);
+		relayTrack.swap(_relay_track);
+		videoSsrcs.swap(_video_ssrcs);
+		videoSwitches.swap(_video_switches);
+		audioSwitches.swap(_audio_switches);
+	}
+
+	// Joining the threads and destroying the factory takes a while, leave it to the teardown thread.
+	Teardown teardown;
+
+	teardown.socket = std::move(_socket);
+	teardown.factory = std::move(_factory);
+	teardown.signal_thread = std::move(_signal_thread);
+	teardown.worker_thread = std::move(_worker_thread);
+	teardown.network_thread = std::move(_network_thread);
+	teardown.task_queue = std::move(_task_queue);
+
+	Async::Call(TeardownExecutor(), std::move(teardown));
 }
 
 std::shared_ptr<RTCDataChannel> RTCPeerConnectionInternal::CreateDataChannel(const String& label, const RTCDataChannelInit& options) {
@@ -141,128 +238,325 @@ std::shared_ptr<RTCDataChannel> RTCPeerConnectionInternal::CreateDataChannel(con
 }
 
 void RTCPeerConnectionInternal::AddIceCandidate(const RTCPeerConnection::RTCIceCandidate& candidate) {
-	Promise<>::New([=](
-		const Promise<>::FullFilledCallback& resolve,
-		const Promise<>::RejectedCallback& reject) {
-			webrtc::SdpParseError error;
-			webrtc::IceCandidateInterface* ice = webrtc::CreateIceCandidate(std::string(candidate.sdpMid), candidate.sdpMLineIndex, std::string(candidate.candidate), &error);
-
-			if (ice && _socket) {
-				if (!_socket->pending_remote_description() && !_socket->current_remote_description()) {
-					_pending_candidates.push_back([=]() {
-						if (_socket->AddIceCandidate(ice)) {
-							return resolve();
-						}
-
-						if (error.description.empty()) {
-							if (!_socket->pending_remote_description() && !_socket->current_remote_description()) {
-								return reject(Error::New("ICE candidates can't be added without any remote session description.", __FILE__, __LINE__));
-							}
-
-							return reject(Error::New("Candidate cannot be used.", __FILE__, __LINE__));
-						}
-						});
-				}
-				else {
-					if (_socket->AddIceCandidate(ice)) {
-						return resolve();
-					}
-
-					if (error.description.empty()) {
-						if (!_socket->pending_remote_description() && !_socket->current_remote_description()) {
-							return reject(Error::New("ICE candidates can't be added without any remote session description.", __FILE__, __LINE__));
-						}
-
-						return reject(Error::New("Candidate cannot be used.", __FILE__, __LINE__));
-					}
-				}
-			}
+	AddIceCandidates({ candidate });
+}
+
+void RTCPeerConnectionInternal::AddIceCandidate(const RTCPeerConnection::RTCIceCandidate& candidate, std::function<void(std::shared_ptr<Error>)> callback) {
+	AddIceCandidates({ candidate }, std::move(callback));
+}
+
+void RTCPeerConnectionInternal::AddIceCandidates(const std::vector<RTCPeerConnection::RTCIceCandidate>& candidates, std::function<void(std::shared_ptr<Error>)> callback) {
+	auto batch = std::make_shared<IceCandidateBatch>();
+	std::vector<std::unique_ptr<webrtc::IceCandidateInterface>> parsed;
+	std::shared_ptr<Error> error;
+
+	batch->callback = std::move(callback);
+	batch->executor = _executor;
+	batch->remaining = candidates.size() + 1;
+
+	parsed.reserve(candidates.size());
+
+	for (const auto& candidate : candidates) {
+		webrtc::SdpParseError parseError;
+		std::unique_ptr<webrtc::IceCandidateInterface> ice(webrtc::CreateIceCandidate(std::string(candidate.sdpMid), candidate.sdpMLineIndex, std::string(candidate.candidate), &parseError));
 
-			return reject(Error::New(error.description.c_str()));
-		})->WaitForResult();
+		if (ice) {
+			parsed.push_back(std::move(ice));
+		}
+		else if (!error) {
+			error = Error::New(parseError.description.c_str(), __FILE__, __LINE__);
+		}
+	}
+
+	// The extra count is released on the signaling thread once every parsed candidate has been handed over.
+	batch->remaining -= candidates.size() - parsed.size();
+
+	if (!_socket) {
+		batch->remaining = 1;
+		batch->Complete(Error::New("SOCKET is NULL!", __FILE__, __LINE__));
+		return;
+	}
+
+	_signal_thread->PostTask([this, batch, error, parsed = std::move(parsed), event = Event::New()]() mutable {
+		for (auto& ice : parsed) {
+			ApplyIceCandidate(std::move(ice), batch);
+		}
+
+		batch->Complete(error);
+	});
+}
+
+void RTCPeerConnectionInternal::ApplyIceCandidate(std::unique_ptr<webrtc::IceCandidateInterface> candidate, const std::shared_ptr<IceCandidateBatch>& batch) {
+	if (!_socket->pending_remote_description() && !_socket->current_remote_description()) {
+		_pending_candidates.push_back({ std::move(candidate), batch });
+		return;
+	}
+
+	_socket->AddIceCandidate(std::move(candidate), [batch](webrtc::RTCError error) {
+		if (error.ok()) {
+			batch->Complete(nullptr);
+		}
+		else {
+			batch->Complete(Error::New(error.message(), __FILE__, __LINE__));
+		}
+	});
+}
+
+void RTCPeerConnectionInternal::ApplyPendingIceCandidates() {
+	if (!_signal_thread->IsCurrent()) {
+		_signal_thread->PostTask([this, event = Event::New()]() { ApplyPendingIceCandidates(); });
+		return;
+	}
+
+	auto pending = std::move(_pending_candidates);
+	_pending_candidates.clear();
+
+	for (auto& entry : pending) {
+		ApplyIceCandidate(std::move(entry.candidate), entry.batch);
+	}
+}
+
+void RTCPeerConnectionInternal::FailPendingIceCandidates(const std::shared_ptr<Error>& error) {
+	auto pending = std::move(_pending_candidates);
+	_pending_candidates.clear();
+
+	for (auto& entry : pending) {
+		entry.batch->Complete(error);
+	}
 }
 
 void RTCPeerConnectionInternal::AddStream(const std::shared_ptr<MediaStream>& stream) {
-	if (_socket)
+	if (_socket && !_data_only)
 		_socket->AddStream(reinterpret_cast<webrtc::MediaStreamInterface*>(stream->GetStream()));
 }
 
-/*
-std::shared_ptr<RTCPeerConnection::RTCRtpSender> RTCPeerConnectionInternal::AddTrack(const std::shared_ptr<MediaStreamTrack> &track, const std::shared_ptr<MediaStream> &stream) {
-  // TODO(): Implement this
-  return std::shared_ptr<RTCPeerConnection::RTCRtpSender>();
-}
-*/
+std::shared_ptr<RTCPeerConnection::RTCRtpSender> RTCPeerConnectionInternal::AddTrack(const std::shared_ptr<MediaStreamTrack>& track, const MediaStreams& streams, const std::vector<RTCRtpEncodingParameters>& sendEncodings) {
+	auto internal = std::dynamic_pointer_cast<MediaStreamTrackInternal>(track);
 
-void RTCPeerConnectionInternal::CreateAnswer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options) {
-	Promise<RTCPeerConnection::RTCSessionDescription>::New([=](
-		const Promise<RTCPeerConnection::RTCSessionDescription>::FullFilledCallback& resolve,
-		const Promise<RTCPeerConnection::RTCSessionDescription>::RejectedCallback& reject) {
-			rtc::scoped_refptr<CreateOfferAnswerObserver> observer = rtc::make_ref_counted<CreateOfferAnswerObserver>(resolve, reject);
-			webrtc::PeerConnectionInterface::RTCOfferAnswerOptions answer_options(
-				true, // offer_to_receive_video
-				true, // offer_to_receive_audio
-				options.voiceActivityDetection, // voice_activity_detection
-				false, // ice_restart 
-				true  // use_rtp_mux
-			);
-
-			if (observer.get() && _socket) {
-				_socket->CreateAnswer(observer.get(), answer_options);
-			}
-			else {
-				reject(Error::New("CreateOfferAnswerObserver Failed", __FILE__, __LINE__));
-			}
+	if (!_socket || _data_only || !internal) {
+		return nullptr;
+	}
+
+	std::vector<std::string> ids;
+
+	for (const auto& stream : streams) {
+		if (stream) {
+			ids.push_back(stream->Id().c_str());
 		}
-	)
-		->Then([=](RTCPeerConnection::RTCSessionDescription desc) mutable {
-			callback(&desc);
-			}
-		);
+	}
+
+	auto result = sendEncodings.empty() ?
+		_socket->AddTrack(internal->GetTrack(), ids) :
+		_socket->AddTrack(internal->GetTrack(), ids, RTCRtpSenderInternal::ToEncodings(sendEncodings, internal->Kind() == MediaStreamTrack::kVideo));
+
+	if (!result.ok()) {
+		RTC_LOG(LS_WARNING) << "AddTrack failed: " << result.error().message();
+		return nullptr;
+	}
+
+	auto sender = result.MoveValue();
+	auto relay = std::dynamic_pointer_cast<VideoRelayTrack>(track);
+
+	if (relay) {
+		ConfigureRelaySender(sender, relay->Source());
+	}
+
+	return std::make_shared<RTCRtpSenderInternal>(std::move(sender), _executor, track);
 }
 
-void RTCPeerConnectionInternal::CreateOffer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options) {
+void RTCPeerConnectionInternal::ConfigureRelaySender(const rtc::scoped_refptr<webrtc::RtpSenderInterface>& sender, VideoRelaySource* source) {
+	// Relayed frames can't be scaled, congestion is handled by dropping them until the next key frame.
+	auto parameters = sender->GetParameters();
+	parameters.degradation_preference = webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
+
+	auto error = sender->SetParameters(parameters);
+
+	if (!error.ok()) {
+		RTC_LOG(LS_WARNING) << "Relay sender parameters not applied: " << error.message();
+	}
+
+	webrtc::VideoCodecType codec = source->Codec();
+
+	if (codec == webrtc::kVideoCodecGeneric) {
+		return;
+	}
+
+	std::vector<webrtc::RtpCodecCapability> codecs;
 
-	Promise<RTCPeerConnection::RTCSessionDescription>::New([=](
-		const Promise<RTCPeerConnection::RTCSessionDescription>::FullFilledCallback& resolve,
-		const Promise<RTCPeerConnection::RTCSessionDescription>::RejectedCallback& reject)
+	for (const auto& capability : _factory->GetRtpSenderCapabilities(cricket::MEDIA_TYPE_VIDEO).codecs) {
+		if (absl::EqualsIgnoreCase(capability.name, webrtc::CodecTypeToPayloadString(codec)) ||
+			absl::EqualsIgnoreCase(capability.name, "rtx") ||
+			absl::EqualsIgnoreCase(capability.name, "red") ||
+			absl::EqualsIgnoreCase(capability.name, "ulpfec"))
 		{
-			rtc::scoped_refptr<CreateOfferAnswerObserver> observer = rtc::make_ref_counted<CreateOfferAnswerObserver>(resolve, reject);
-			webrtc::PeerConnectionInterface::RTCOfferAnswerOptions offer_options(
-				1, // offer_to_receive_video
-				1, // offer_to_receive_audio
-				options.voiceActivityDetection, // voice_activity_detection
-				options.iceRestart, // ice_restart 
-				true  // use_rtp_mux
-			);
-
-			if (observer.get() && _socket) {
-				_socket->CreateOffer(observer.get(), offer_options);
-			}
-			else {
-				reject(Error::New("CreateOfferAnswerObserver Failed", __FILE__, __LINE__));
-			}
+			codecs.push_back(capability);
 		}
-	)
-		->Then([=](RTCPeerConnection::RTCSessionDescription desc) mutable {
-			callback(&desc);
+	}
+
+	for (const auto& transceiver : _socket->GetTransceivers()) {
+		if (transceiver->sender() == sender) {
+			error = transceiver->SetCodecPreferences(codecs);
+
+			if (!error.ok()) {
+				RTC_LOG(LS_WARNING) << "Relay codec preference not applied: " << error.message();
 			}
+
+			break;
+		}
+	}
+}
+
+bool RTCPeerConnectionInternal::RemoveTrack(const std::shared_ptr<RTCRtpSender>& sender) {
+	auto internal = std::dynamic_pointer_cast<RTCRtpSenderInternal>(sender);
+
+	if (!_socket || !internal) {
+		return false;
+	}
+
+	return _socket->RemoveTrackOrError(internal->Sender()).ok();
+}
+
+std::vector<std::shared_ptr<RTCPeerConnection::RTCRtpSender>> RTCPeerConnectionInternal::GetSenders() {
+	std::vector<std::shared_ptr<RTCRtpSender>> senders;
+
+	if (_socket) {
+		for (auto& sender : _socket->GetSenders()) {
+			senders.push_back(std::make_shared<RTCRtpSenderInternal>(std::move(sender), _executor));
+		}
+	}
+
+	return senders;
+}
+
+std::shared_ptr<RTCPeerConnection::RTCRtpTransceiver> RTCPeerConnectionInternal::AddTransceiver(MediaStreamTrack::Type kind, const RTCRtpTransceiverInit& init) {
+	if (!_socket || _data_only) {
+		return nullptr;
+	}
+
+	auto result = _socket->AddTransceiver((kind == MediaStreamTrack::kAudio) ? cricket::MEDIA_TYPE_AUDIO : cricket::MEDIA_TYPE_VIDEO, TransceiverInit(init, kind == MediaStreamTrack::kVideo));
+
+	if (!result.ok()) {
+		RTC_LOG(LS_WARNING) << "AddTransceiver failed: " << result.error().message();
+		return nullptr;
+	}
+
+	return std::make_shared<RTCRtpTransceiverInternal>(result.MoveValue(), _executor);
+}
+
+std::shared_ptr<RTCPeerConnection::RTCRtpTransceiver> RTCPeerConnectionInternal::AddTransceiver(const std::shared_ptr<MediaStreamTrack>& track, const RTCRtpTransceiverInit& init) {
+	auto internal = std::dynamic_pointer_cast<MediaStreamTrackInternal>(track);
+
+	if (!_socket || _data_only || !internal) {
+		return nullptr;
+	}
+
+	auto result = _socket->AddTransceiver(internal->GetTrack(), TransceiverInit(init, internal->Kind() == MediaStreamTrack::kVideo));
+
+	if (!result.ok()) {
+		RTC_LOG(LS_WARNING) << "AddTransceiver failed: " << result.error().message();
+		return nullptr;
+	}
+
+	return std::make_shared<RTCRtpTransceiverInternal>(result.MoveValue(), _executor, track);
+}
+
+std::vector<std::shared_ptr<RTCPeerConnection::RTCRtpTransceiver>> RTCPeerConnectionInternal::GetTransceivers() {
+	std::vector<std::shared_ptr<RTCRtpTransceiver>> transceivers;
+
+	if (_socket) {
+		for (auto& transceiver : _socket->GetTransceivers()) {
+			transceivers.push_back(std::make_shared<RTCRtpTransceiverInternal>(std::move(transceiver), _executor));
+		}
+	}
+
+	return transceivers;
+}
+
+void RTCPeerConnectionInternal::CreateAnswer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options) {
+	CreateAnswer([callback](std::shared_ptr<Error> error, RTCPeerConnection::RTCSessionDescription* sdp) {
+		if (!error && callback) {
+			callback(sdp);
+		}
+	}, options);
+}
+
+void RTCPeerConnectionInternal::CreateAnswer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options) {
+	auto observer = rtc::make_ref_counted<CreateOfferAnswerObserver>(_operations, std::move(callback));
+
+	_operations->Queue([observer, options]() {
+		auto pc = observer->Connection();
+
+		bool audio = pc && !pc->_data_only && options.offerToReceiveAudio;
+		bool video = pc && !pc->_data_only && options.offerToReceiveVideo;
+
+		webrtc::PeerConnectionInterface::RTCOfferAnswerOptions answer_options(
+			video, // offer_to_receive_video
+			audio, // offer_to_receive_audio
+			options.voiceActivityDetection, // voice_activity_detection
+			false, // ice_restart 
+			true  // use_rtp_mux
 		);
+
+		if (pc && pc->_socket) {
+			// Unified Plan answers ignore offer_to_receive_*, the transceivers the remote offer created are changed instead.
+			for (const auto& transceiver : pc->_socket->GetTransceivers()) {
+				bool receive = (transceiver->media_type() == cricket::MEDIA_TYPE_AUDIO) ? audio : video;
+
+				if (receive || transceiver->stopping()) {
+					continue;
+				}
+
+				if (transceiver->direction() == webrtc::RtpTransceiverDirection::kRecvOnly) {
+					transceiver->StopStandard();
+				}
+				else if (transceiver->direction() == webrtc::RtpTransceiverDirection::kSendRecv) {
+					transceiver->SetDirectionWithError(webrtc::RtpTransceiverDirection::kSendOnly);
+				}
+			}
+
+			pc->_socket->CreateAnswer(observer.get(), answer_options);
+		}
+		else {
+			observer->Complete(Error::New("CreateOfferAnswerObserver Failed", __FILE__, __LINE__));
+		}
+	});
 }
 
-/*
-std::shared_ptr<Promise<RTCPeerConnection::RTCCertificate>> RTCPeerConnectionInternal::GenerateCertificate() {
-  std::shared_ptr<RTCPeerConnection> self(this);
+void RTCPeerConnectionInternal::CreateOffer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options) {
+	CreateOffer([callback](std::shared_ptr<Error> error, RTCPeerConnection::RTCSessionDescription* sdp) {
+		if (!error && callback) {
+			callback(sdp);
+		}
+	}, options);
+}
+
+void RTCPeerConnectionInternal::CreateOffer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options) {
+	auto observer = rtc::make_ref_counted<CreateOfferAnswerObserver>(_operations, std::move(callback));
+
+	_operations->Queue([observer, options]() {
+		auto pc = observer->Connection();
 
-  return Promise<RTCPeerConnection::RTCCertificate>::New([=](
-	const Promise<RTCPeerConnection::RTCCertificate>::FullFilledCallback &resolve,
-	const Promise<RTCPeerConnection::RTCCertificate>::RejectedCallback &reject)
-  {
-	  // TODO(): Implement this
+		// kUndefined leaves the media sections to the transceivers, 1 adds a receive-only one when the kind has none.
+		bool media = pc && !pc->_data_only;
+		int audio = (media && options.offerToReceiveAudio) ? 1 : webrtc::PeerConnectionInterface::RTCOfferAnswerOptions::kUndefined;
+		int video = (media && options.offerToReceiveVideo) ? 1 : webrtc::PeerConnectionInterface::RTCOfferAnswerOptions::kUndefined;
 
-  });
+		webrtc::PeerConnectionInterface::RTCOfferAnswerOptions offer_options(
+			video, // offer_to_receive_video
+			audio, // offer_to_receive_audio
+			options.voiceActivityDetection, // voice_activity_detection
+			options.iceRestart, // ice_restart 
+			true  // use_rtp_mux
+		);
+
+		if (pc && pc->_socket) {
+			pc->_socket->CreateOffer(observer.get(), offer_options);
+		}
+		else {
+			observer->Complete(Error::New("CreateOfferAnswerObserver Failed", __FILE__, __LINE__));
+		}
+	});
 }
-*/
 
 MediaStreams RTCPeerConnectionInternal::GetLocalStreams() {
 	MediaStreams streams;
@@ -303,17 +597,27 @@ void RTCPeerConnectionInternal::RemoveStream(const std::shared_ptr<MediaStream>&
 		_socket->RemoveStream(reinterpret_cast<webrtc::MediaStreamInterface*>(stream->GetStream()));
 }
 
-/*
-void RTCPeerConnectionInternal::RemoveTrack(const std::shared_ptr<RTCPeerConnection::RTCRtpSender> &sender) {
-  // TODO(): Implement this
-}
-*/
-
 bool RTCPeerConnectionInternal::SetConfiguration(const RTCPeerConnection::RTCConfiguration& config) {
 	webrtc::PeerConnectionInterface::RTCConfiguration cfg(webrtc::PeerConnectionInterface::RTCConfigurationType::kAggressive);
 
 	auto error = ParseConfiguration(config, &cfg);
 
+	_executor = config.executor ? config.executor : Executor::Default();
+	_operations->executor = _executor;
+
+	if (_video_encoder_factory) {
+		_video_encoder_factory->SetBroadcastGroup(config.videoBroadcastGroup.c_str());
+	}
+
+	if (!error && cfg.certificates.empty()) {
+		// Saves the PeerConnection from generating a key of its own before the first offer/answer.
+		auto certificate = PeerConnectionPool::AcquireCertificate();
+
+		if (certificate) {
+			cfg.certificates.push_back(certificate);
+		}
+	}
+
 	if (!error) {
 		webrtc::PeerConnectionDependencies pc_dependencies(this);
 		auto error_or_peer_connection = _factory->CreatePeerConnectionOrError(cfg, std::move(pc_dependencies));
@@ -328,79 +632,169 @@ bool RTCPeerConnectionInternal::SetConfiguration(const RTCPeerConnection::RTCCon
 }
 
 void RTCPeerConnectionInternal::SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp) {
+	SetLocalDescription(std::move(sdp), nullptr);
+}
+
+void RTCPeerConnectionInternal::SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) {
+	auto observer = rtc::make_ref_counted<SetDescriptionObserver>(_operations, std::move(callback));
+
+	_operations->Queue([observer, sdp]() {
+		auto pc = observer->Connection();
+		auto desc = SDP2SDP(sdp.get());
+
+		if (desc && pc && pc->_socket) {
+			pc->_socket->SetLocalDescription(std::move(desc), rtc::scoped_refptr<webrtc::SetLocalDescriptionObserverInterface>(observer));
+		}
+		else {
+			observer->Complete(Error::New("Failed to create local description from SDP", __FILE__, __LINE__));
+		}
+	});
+}
+
+void RTCPeerConnectionInternal::SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp) {
+	SetRemoteDescription(std::move(sdp), nullptr);
+}
+
+void RTCPeerConnectionInternal::SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) {
+	auto observer = rtc::make_ref_counted<SetDescriptionObserver>(_operations, std::move(callback));
+
+	_operations->Queue([observer, sdp]() {
+		auto pc = observer->Connection();
 
-	if (!_settingLocalDesc)
+		if (!pc || !pc->_socket) {
+			observer->Complete(Error::New("SOCKET is NULL!", __FILE__, __LINE__));
+			return;
+		}
+
+		auto desc = SDP2SDP(sdp.get());
+
+		if (desc) {
+			pc->_socket->SetRemoteDescription(std::move(desc), rtc::scoped_refptr<webrtc::SetRemoteDescriptionObserverInterface>(observer));
+		}
+		else {
+			observer->Complete(Error::New("Failed to create remote description from SDP", __FILE__, __LINE__));
+		}
+	});
+}
+
+void RTCPeerConnectionInternal::Operations::Queue(Task operation) {
 	{
-		_settingLocalDesc = true;
-		Promise<>::New([=](
-			const Promise<>::FullFilledCallback& resolve,
-			const Promise<>::RejectedCallback& reject)
-			{
-				auto desc = SDP2SDP(sdp.get());
-
-				if (desc && _socket) {
-					auto observer = rtc::make_ref_counted<SetLocalDescriptionObserver>(resolve, reject);
-					_socket->SetLocalDescription(std::move(desc), observer);
-				}
-				else {
-					reject(Error::New("Failed to create local description from SDP", __FILE__, __LINE__));
-				}
-			})->Finally([=]() {
-				_settingLocalDesc = false;
-			});
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (running) {
+			queue.push_back(std::move(operation));
+			return;
+		}
+
+		running = true;
 	}
+
+	operation();
 }
 
-void RTCPeerConnectionInternal::SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp) {
-	if (!_settingRemoteDesc)
+void RTCPeerConnectionInternal::Operations::Complete() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (queue.empty()) {
+		running = false;
+		return;
+	}
+
+	// Never inline: the next operation may fail right away and post its result ahead of the caller's,
+	// and a chain of such failures would recurse. Posted under the mutex so the thread can't be cleared meanwhile.
+	auto self = shared_from_this();
+
+	if (thread) {
+		thread->PostTask([self]() { self->Next(); });
+	}
+	else {
+		// The connection is gone, the remaining operations fail without it.
+		Async::Call(executor, [self]() { self->Next(); });
+	}
+}
+
+void RTCPeerConnectionInternal::Operations::Next() {
+	Task operation;
+
 	{
-		_settingRemoteDesc = true;
-		Promise<>::New([=](
-			const Promise<>::FullFilledCallback& resolve,
-			const Promise<>::RejectedCallback& reject)
-			{
-				if (_socket) {
-					Promise<>::New([=](const Promise<>::FullFilledCallback& res, const Promise<>::RejectedCallback& rej) {
-						auto desc = SDP2SDP(sdp.get());
-						if (desc)
-						{
-							auto observer = rtc::make_ref_counted<SetRemoteDescriptionObserver>(res, rej);
-							_socket->SetRemoteDescription(std::move(desc), observer);
-						}
-						else {
-							reject(Error::New("Failed to create remote description from SDP", __FILE__, __LINE__));
-						}
-						})->Then([=]()
-							{
-								if (_pending_candidates.size()) {
-									for (const auto& callback : _pending_candidates) {
-										callback();
-									}
-
-									_pending_candidates.clear();
-								}
-								resolve();
-							}
-						)->Catch([=](const std::shared_ptr<Error>& error)
-							{
-								reject(error);
-							});
-				}
-				else {
-					reject(Error::New("SOCKET is NULL!", __FILE__, __LINE__));
-				}
-			})->Finally([=]() {
-				_settingRemoteDesc = false;
-				});
+		std::lock_guard<std::mutex> lock(mutex);
+
+		operation = std::move(queue.front());
+		queue.pop_front();
 	}
+
+	operation();
 }
 
 void RTCPeerConnectionInternal::Close() {
+	StopRecorder();
+
 	if (_socket && _socket->signaling_state() != webrtc::PeerConnectionInterface::kClosed) {
 		_socket->Close();
 	}
 }
 
+void RTCPeerConnectionInternal::Close(std::function<void()> callback) {
+	StopRecorder();
+
+	_signal_thread->PostTask([this, callback = std::move(callback), event = Event::New()]() mutable {
+		if (_socket && _socket->signaling_state() != webrtc::PeerConnectionInterface::kClosed) {
+			_socket->Close();
+		}
+
+		// Queued behind every pending operation, which fail fast now that the connection is closed.
+		auto operations = _operations;
+
+		operations->Queue([operations, callback = std::move(callback), event = std::move(event)]() mutable {
+			if (callback) {
+				Async::Call(operations->executor, std::move(callback));
+			}
+
+			operations->Complete();
+		});
+	});
+}
+
+void RTCPeerConnectionInternal::GetStats(std::function<void(std::shared_ptr<Error>, const RTCStatsReport&)> callback, const RTCStatsOptions& options) {
+	auto collector = rtc::make_ref_counted<RTCStatsCollector>(_executor, std::move(callback), options.cheap);
+	auto track = std::dynamic_pointer_cast<MediaStreamTrackInternal>(options.track);
+
+	if (options.track && !track) {
+		collector->Fail(Error::New("Invalid MediaStreamTrack", __FILE__, __LINE__));
+		return;
+	}
+
+	_signal_thread->PostTask([this, collector, track]() {
+		if (!_socket) {
+			collector->Fail(Error::New("RTCPeerConnection is closed", __FILE__, __LINE__));
+			return;
+		}
+
+		if (!track) {
+			_socket->GetStats(collector.get());
+			return;
+		}
+
+		// Selectors keep WebRTC from collecting the stats of every other stream.
+		auto selector = track->GetTrack();
+
+		for (const auto& sender : _socket->GetSenders()) {
+			if (sender->track() == selector) {
+				_socket->GetStats(sender, collector);
+				return;
+			}
+		}
+
+		for (const auto& receiver : _socket->GetReceivers()) {
+			if (receiver->track() == selector) {
+				_socket->GetStats(receiver, collector);
+				return;
+			}
+		}
+
+		collector->Fail(Error::New("MediaStreamTrack is not attached to this RTCPeerConnection", __FILE__, __LINE__));
+	});
+}
 
 RTCPeerConnection::RTCSessionDescription RTCPeerConnectionInternal::CurrentLocalDescription() {
 	RTCPeerConnection::RTCSessionDescription sdp;
@@ -609,12 +1003,24 @@ void RTCPeerConnectionInternal::OnIceConnectionReceivingChange(bool receiving) {
 
 bool crtc::RTCPeerConnectionInternal::BypassVideoDecoder()
 {
-	return _onRawVideo;
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+	return BypassesVideo();
 }
 
 bool crtc::RTCPeerConnectionInternal::BypassAudioDecoder()
 {
-	return _onRawAudio;
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+	return BypassesAudio();
+}
+
+bool crtc::RTCPeerConnectionInternal::BypassesVideo() const
+{
+	return _raw_video || _relay_source || (_recorder && _recorder->RecordsVideo());
+}
+
+bool crtc::RTCPeerConnectionInternal::BypassesAudio() const
+{
+	return _raw_audio || (_recorder && _recorder->RecordsAudio());
 }
 
 void crtc::RTCPeerConnectionInternal::onRawVideo(const webrtc::EncodedImage& input_image, int64_t render_time_ms)
@@ -623,6 +1029,209 @@ void crtc::RTCPeerConnectionInternal::onRawVideo(const webrtc::EncodedImage& inp
 		_onRawVideo(input_image.data(), input_image.size(), input_image.FrameType() == webrtc::VideoFrameType::kVideoFrameKey, render_time_ms);
 }
 
+std::shared_ptr<MediaStreamTrack> crtc::RTCPeerConnectionInternal::CreateVideoRelay()
+{
+	if (_data_only) {
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+	if (!_relay_track) {
+		auto source = rtc::make_ref_counted<VideoRelaySource>(CustomVideoEncoderFactory::KeyFrameIntervalMs());
+		auto track = VideoRelayTrack::New(source);
+
+		if (!track) {
+			return nullptr;
+		}
+
+		_relay_source = source;
+		_relay_track = std::move(track);
+	}
+
+	return _relay_track;
+}
+
+bool crtc::RTCPeerConnectionInternal::RelayVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec)
+{
+	rtc::scoped_refptr<VideoRelaySource> source;
+
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+		source = _relay_source;
+	}
+
+	return source && source->Push(image, codec);
+}
+
+void crtc::RTCPeerConnectionInternal::RelayVideoCodec(webrtc::VideoCodecType codec)
+{
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+	if (_relay_source) {
+		_relay_source->SetCodec(codec);
+	}
+}
+
+std::shared_ptr<RTCPeerConnection::RTCRecorder> crtc::RTCPeerConnectionInternal::Record(const RTCRecorderOptions& options)
+{
+	if (_data_only) {
+		return nullptr;
+	}
+
+	auto recorder = RTCRecorderInternal::New(options, _executor);
+
+	if (!recorder) {
+		return nullptr;
+	}
+
+	std::shared_ptr<RTCRecorderInternal> previous;
+
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+		previous = std::move(_recorder);
+		_recorder = recorder;
+	}
+
+	if (previous) {
+		previous->Stop();
+	}
+
+	return recorder;
+}
+
+void crtc::RTCPeerConnectionInternal::RecordVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec)
+{
+	std::shared_ptr<RTCRecorderInternal> recorder;
+
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+		recorder = _recorder;
+	}
+
+	if (recorder) {
+		recorder->PushVideo(image, codec);
+	}
+}
+
+void crtc::RTCPeerConnectionInternal::RecordAudio(const uint8_t* data, size_t length, uint32_t timestamp, size_t channels)
+{
+	std::shared_ptr<RTCRecorderInternal> recorder;
+
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+		recorder = _recorder;
+	}
+
+	if (recorder) {
+		recorder->PushAudio(data, length, timestamp, channels);
+	}
+}
+
+void crtc::RTCPeerConnectionInternal::VideoDecodeMode(const webrtc::EncodedImage& image, bool* decode, bool* passthrough)
+{
+	bool bypass;
+	std::shared_ptr<DecodeSwitch> decodeSwitch;
+
+	// A single lock per frame, the bypass and the switch are read together.
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+		bypass = BypassesVideo();
+
+		if (!image.PacketInfos().empty()) {
+			auto it = _video_ssrcs.find(image.PacketInfos().begin()->ssrc());
+
+			if (it != _video_ssrcs.end()) {
+				decodeSwitch = it->second;
+			}
+		}
+
+		// Streams without signaled SSRCs can still be matched when there is only one.
+		if (!decodeSwitch && _video_switches.size() == 1) {
+			decodeSwitch = _video_switches.front();
+		}
+	}
+
+	*decode = decodeSwitch ? decodeSwitch->Decodes(bypass) : !bypass;
+	*passthrough = decodeSwitch ? decodeSwitch->PassesThrough(bypass) : bypass;
+}
+
+void crtc::RTCPeerConnectionInternal::AudioDecodeMode(bool* decode, bool* passthrough)
+{
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+	bool bypass = BypassesAudio();
+
+	if (_audio_switches.empty()) {
+		*decode = !bypass;
+		*passthrough = bypass;
+		return;
+	}
+
+	*decode = false;
+	*passthrough = false;
+
+	for (const auto& decodeSwitch : _audio_switches) {
+		*decode = *decode || decodeSwitch->Decodes(bypass);
+		*passthrough = *passthrough || decodeSwitch->PassesThrough(bypass);
+	}
+}
+
+// On the signaling thread, after every description applied. Receivers know their SSRCs by then.
+void crtc::RTCPeerConnectionInternal::UpdateDecodeSwitches()
+{
+	if (_data_only || !_socket) {
+		return;
+	}
+
+	std::map<uint32_t, std::shared_ptr<DecodeSwitch>> videoSsrcs;
+	std::vector<std::shared_ptr<DecodeSwitch>> videoSwitches;
+	std::vector<std::shared_ptr<DecodeSwitch>> audioSwitches;
+
+	for (const auto& receiver : _socket->GetReceivers()) {
+		rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> track = receiver->track();
+
+		if (!track) {
+			continue;
+		}
+
+		auto decodeSwitch = DecodeSwitch::For(track);
+
+		if (receiver->media_type() == cricket::MEDIA_TYPE_AUDIO) {
+			audioSwitches.push_back(decodeSwitch);
+			continue;
+		}
+
+		for (const auto& encoding : receiver->GetParameters().encodings) {
+			if (encoding.ssrc) {
+				videoSsrcs[*encoding.ssrc] = decodeSwitch;
+			}
+		}
+
+		videoSwitches.push_back(std::move(decodeSwitch));
+	}
+
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+	_video_ssrcs.swap(videoSsrcs);
+	_video_switches.swap(videoSwitches);
+	_audio_switches.swap(audioSwitches);
+}
+
+void crtc::RTCPeerConnectionInternal::StopRecorder()
+{
+	std::shared_ptr<RTCRecorderInternal> recorder;
+
+	{
+		std::lock_guard<std::mutex> lock(_bypass_mutex);
+		recorder = std::move(_recorder);
+	}
+
+	if (recorder) {
+		recorder->Stop();
+	}
+}
+
 void crtc::RTCPeerConnectionInternal::onRawAudio(const uint8_t* data, size_t data_length)
 {
 	if (_onRawAudio)
@@ -631,11 +1240,17 @@ void crtc::RTCPeerConnectionInternal::onRawAudio(const uint8_t* data, size_t dat
 
 void crtc::RTCPeerConnectionInternal::onRawVideo(std::function<void((const unsigned char* data, size_t length, bool isKeyFrame, int64_t renderTimeMs))> callback)
 {
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+	_raw_video = static_cast<bool>(callback);
 	_onRawVideo = callback;
 }
 
 void crtc::RTCPeerConnectionInternal::onRawAudio(std::function<void((const unsigned char* data, size_t length))> callback)
 {
+	std::lock_guard<std::mutex> lock(_bypass_mutex);
+
+	_raw_audio = static_cast<bool>(callback);
 	_onRawAudio = callback;
 }
 
@@ -712,17 +1327,36 @@ void RTCPeerConnectionInternal::OnRemoveStream(webrtc::MediaStreamInterface* str
 
 
 std::shared_ptr<RTCPeerConnection> RTCPeerConnection::New(const RTCPeerConnection::RTCConfiguration& config) {
-	auto pc = std::make_shared<RTCPeerConnectionInternal>();
+	// Pooled connections carry a media engine, data-only ones are cheap enough to build on demand.
+	auto pc = config.dataChannelsOnly ? nullptr : PeerConnectionPool::Acquire();
+	if (!pc)
+		pc = std::make_shared<RTCPeerConnectionInternal>(config.dataChannelsOnly);
 	if (pc && pc->SetConfiguration(config))
 		return pc;
 	return nullptr;
 }
 
+std::vector<std::shared_ptr<RTCPeerConnection>> RTCPeerConnection::NewBatch(size_t count, const RTCPeerConnection::RTCConfiguration& config) {
+	std::vector<std::shared_ptr<RTCPeerConnection>> result;
+	result.reserve(count);
+
+	for (size_t index = 0; index < count; index++) {
+		auto pc = New(config);
+
+		if (pc) {
+			result.push_back(std::move(pc));
+		}
+	}
+
+	return result;
+}
+
 RTCPeerConnection::RTCConfiguration::RTCConfiguration() :
 	iceCandidatePoolSize(0),
 	bundlePolicy(kMaxBundle),
 	iceTransportPolicy(kAll),
-	rtcpMuxPolicy(kRequire)
+	rtcpMuxPolicy(kRequire),
+	dataChannelsOnly(false)
 {
 	RTCIceServer iceserver;
 	iceserver.urls.push_back(String("stun:stun.l.google.com:19302"));
@@ -30,9 +30,15 @@
 #include "crtc.h"
 #include "event.h"
 #include "utils.hpp"
-#include "promise.h"
+#include "metrics.h"
 #include "mediastreamtrack.h"
 #include "mediastream.h"
+#include "rtccertificate.h"
+#include "rtcstats.h"
+#include "trace.h"
+#include <deque>
+#include <map>
+#include <mutex>
 #include <api/peer_connection_interface.h>
 #include <api/create_peerconnection_factory.h>
 #include <api/task_queue/default_task_queue_factory.h>
@@ -41,29 +47,45 @@
 #include <modules/video_coding/codecs/h264/include/h264.h>
 
 namespace crtc {
+	class CustomVideoEncoderFactory;
+	class DecodeSwitch;
 	class RTCPeerConnectionInternal;
+	class RTCRecorderInternal;
+	class VideoRelaySource;
 
 	class RTCPeerConnectionInternal : public RTCPeerConnection, public webrtc::PeerConnectionObserver {
 		friend class RTCPeerConnectionObserver;
 
 	public:
-		explicit RTCPeerConnectionInternal();
+		// Connections with dataChannelsOnly get no audio or video engine and share one thread for network and worker.
+		explicit RTCPeerConnectionInternal(bool dataChannelsOnly = false);
 		virtual ~RTCPeerConnectionInternal() override;
 
 		std::shared_ptr<RTCDataChannel> CreateDataChannel(const String& label, const RTCDataChannelInit& options = RTCDataChannelInit()) override;
 		void AddIceCandidate(const RTCPeerConnection::RTCIceCandidate& candidate) override;
+		void AddIceCandidate(const RTCPeerConnection::RTCIceCandidate& candidate, std::function<void(std::shared_ptr<Error>)> callback) override;
+		void AddIceCandidates(const std::vector<RTCPeerConnection::RTCIceCandidate>& candidates, std::function<void(std::shared_ptr<Error>)> callback = nullptr) override;
 		void AddStream(const std::shared_ptr<MediaStream>& stream) override;
-		// Let<RTCPeerConnection::RTCRtpSender> AddTrack(const Let<MediaStreamTrack> &track, const Let<MediaStream> &stream) override;
+		std::shared_ptr<RTCRtpSender> AddTrack(const std::shared_ptr<MediaStreamTrack>& track, const MediaStreams& streams, const std::vector<RTCRtpEncodingParameters>& sendEncodings) override;
+		bool RemoveTrack(const std::shared_ptr<RTCRtpSender>& sender) override;
+		std::vector<std::shared_ptr<RTCRtpSender>> GetSenders() override;
+		std::shared_ptr<RTCRtpTransceiver> AddTransceiver(MediaStreamTrack::Type kind, const RTCRtpTransceiverInit& init) override;
+		std::shared_ptr<RTCRtpTransceiver> AddTransceiver(const std::shared_ptr<MediaStreamTrack>& track, const RTCRtpTransceiverInit& init) override;
 		void CreateAnswer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options) override;
+		void CreateAnswer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCAnswerOptions& options) override;
 		void CreateOffer(std::function<void(RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options) override;
-		// Let<Promise<RTCPeerConnection::RTCCertificate>> GenerateCertificate() override;
+		void CreateOffer(std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> callback, const RTCOfferOptions& options) override;
 		MediaStreams GetLocalStreams() override;
 		MediaStreams GetRemoteStreams() override;
+		std::vector<std::shared_ptr<RTCRtpTransceiver>> GetTransceivers() override;
 		void RemoveStream(const std::shared_ptr<MediaStream>& stream) override;
-		// void RemoveTrack(const Let<RTCPeerConnection::RTCRtpSender> &sender) override;
 		void SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp) override;
+		void SetLocalDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) override;
 		void SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp) override;
+		void SetRemoteDescription(std::shared_ptr<const RTCSessionDescription> sdp, std::function<void(std::shared_ptr<Error>)> callback) override;
 		void Close() override;
+		void Close(std::function<void()> callback) override;
+		void GetStats(std::function<void(std::shared_ptr<Error>, const RTCStatsReport&)> callback, const RTCStatsOptions& options) override;
 
 		bool SetConfiguration(const RTCPeerConnection::RTCConfiguration& config);
 		RTCPeerConnection::RTCSessionDescription CurrentLocalDescription() override;
@@ -81,6 +103,19 @@ namespace crtc {
 		void onRawVideo(const webrtc::EncodedImage& input_image, int64_t render_time_ms);
 		void onRawAudio(const uint8_t* data, size_t data_length);
 
+		std::shared_ptr<MediaStreamTrack> CreateVideoRelay() override;
+		bool RelayVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec);
+		void RelayVideoCodec(webrtc::VideoCodecType codec);
+
+		std::shared_ptr<RTCRecorder> Record(const RTCRecorderOptions& options) override;
+		void RecordVideo(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec);
+		void RecordAudio(const uint8_t* data, size_t length, uint32_t timestamp, size_t channels);
+
+		// Asked by the decoders for every frame. Video frames are matched to their track by SSRC, audio decoders
+		// follow every audio track of the connection.
+		void VideoDecodeMode(const webrtc::EncodedImage& image, bool* decode, bool* passthrough);
+		void AudioDecodeMode(bool* decode, bool* passthrough);
+
 		void onRawVideo(std::function<void(const unsigned char* data, size_t length, bool isKeyFrame, int64_t renderTimeMs)> callback) override;
 		void onRawAudio(std::function<void(const unsigned char* data, size_t length)> callback) override;
 		void onAddTrack(std::function<void(const std::shared_ptr<MediaStreamTrack>)> callback) override;
@@ -180,7 +215,15 @@ namespace crtc {
 			webrtc::PeerConnectionInterface::RTCConfiguration* cfg = nullptr)
 		{
 			if (cfg) {
-				// cfg->certificates = config.certificates;
+				for (const auto& certificate : config.certificates) {
+					auto internal = std::dynamic_pointer_cast<RTCCertificateInternal>(certificate);
+
+					if (!internal) {
+						return Error::New("Invalid RTCCertificate", __FILE__, __LINE__);
+					}
+
+					cfg->certificates.push_back(internal->Certificate());
+				}
 
 				cfg->ice_candidate_pool_size = config.iceCandidatePoolSize;
 
@@ -236,82 +279,197 @@ namespace crtc {
 			return Error::New("Invalid RTCConfiguration", __FILE__, __LINE__);
 		}
 
+		// Offer/answer operations run one at a time in call order. Shared with the observers, which can
+		// outlive the connection: pc is cleared on the signaling thread when the connection is destroyed.
+		struct Operations : public std::enable_shared_from_this<Operations> {
+			std::mutex mutex;
+			std::deque<Task> queue;
+			bool running = false;
+			RTCPeerConnectionInternal* pc = nullptr;
+			std::shared_ptr<Executor> executor;
+			// Starts the queued operations, cleared together with pc under the mutex.
+			rtc::Thread* thread = nullptr;
+
+			void Queue(Task operation);
+			// Called once the running operation has posted its result, the next one starts from a task of its own.
+			void Complete();
+
+		private:
+			void Next();
+		};
+
+		// Observers complete the running operation and deliver the result on the connection's executor.
+		// They embed the Event keeping the module loop alive, so an operation costs a single allocation.
+		// An observer released by WebRTC without a result reports the operation as aborted.
+
 		class CreateOfferAnswerObserver : public webrtc::CreateSessionDescriptionObserver {
 		public:
-			CreateOfferAnswerObserver(const Promise<RTCPeerConnection::RTCSessionDescription>::FullFilledCallback& resolve,
-				const Promise<RTCPeerConnection::RTCSessionDescription>::RejectedCallback& reject) :
-				_resolve(resolve),
-				_reject(reject)
+			CreateOfferAnswerObserver(const std::shared_ptr<Operations>& operations, std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)>&& callback) :
+				_operations(operations),
+				_callback(std::move(callback)),
+				_completed(false),
+				_trace_start(CRTC_TRACE_NOW()),
+				_queued(MetricsRegistry::Now())
 			{ }
 
-			~CreateOfferAnswerObserver() override { }
-
-		private:
-			void OnSuccess(webrtc::SessionDescriptionInterface* desc) override {
-				RTCPeerConnection::RTCSessionDescription sdp;
+			~CreateOfferAnswerObserver() override {
+				if (!_completed) {
+					MetricsRegistry::Add(MetricsRegistry::kSdpOperations);
+					MetricsRegistry::Record(MetricsRegistry::kSdpOperationLatency, _queued);
 
-				auto error = SDP2SDP(desc, &sdp);
+					if (_callback) {
+						Async::Call(_operations->executor, [callback = std::move(_callback)]() {
+							callback(Error::New("RTCPeerConnection closed before the operation completed", __FILE__, __LINE__), nullptr);
+						});
+					}
 
-				if (!error) {
-					_resolve(sdp);
+					_operations->Complete();
 				}
-				else {
-					_reject(error);
+			}
+
+			RTCPeerConnectionInternal* Connection() const {
+				return _operations->pc;
+			}
+
+			void Complete(std::shared_ptr<Error> error) {
+				rtc::scoped_refptr<CreateOfferAnswerObserver> self(this);
+
+				_error = std::move(error);
+				_completed = true;
+
+				CRTC_TRACE_SPAN("sdp", "CreateOffer/CreateAnswer", _trace_start);
+				MetricsRegistry::Add(MetricsRegistry::kSdpOperations);
+				MetricsRegistry::Record(MetricsRegistry::kSdpOperationLatency, _queued);
+
+				if (_callback) {
+					Async::Call(_operations->executor, [self]() {
+						self->_callback(self->_error, self->_error ? nullptr : &self->_sdp);
+					});
 				}
+
+				_operations->Complete();
+			}
+
+		private:
+			void OnSuccess(webrtc::SessionDescriptionInterface* desc) override {
+				std::unique_ptr<webrtc::SessionDescriptionInterface> owned(desc);
+				Complete(SDP2SDP(owned.get(), &_sdp));
 			}
 
 			void OnFailure(webrtc::RTCError error) override {
-				_reject(Error::New(error.message(), __FILE__, __LINE__));
+				Complete(Error::New(error.message(), __FILE__, __LINE__));
 			}
 
-			Promise<RTCPeerConnection::RTCSessionDescription>::FullFilledCallback _resolve;
-			Promise<RTCPeerConnection::RTCSessionDescription>::RejectedCallback _reject;
+			std::shared_ptr<Operations> _operations;
+			std::function<void(std::shared_ptr<Error>, RTCPeerConnection::RTCSessionDescription*)> _callback;
+			std::shared_ptr<Error> _error;
+			RTCPeerConnection::RTCSessionDescription _sdp;
+			bool _completed;
+			int64_t _trace_start;
+			int64_t _queued;
+			Event _event;
 		};
 
-		class SetLocalDescriptionObserver : public webrtc::SetLocalDescriptionObserverInterface {
+		class SetDescriptionObserver : public webrtc::SetLocalDescriptionObserverInterface, public webrtc::SetRemoteDescriptionObserverInterface {
 		public:
-			SetLocalDescriptionObserver(const Promise<>::FullFilledCallback& resolve,
-				const Promise<>::RejectedCallback& reject) :
-				_resolve(resolve),
-				_reject(reject)
+			SetDescriptionObserver(const std::shared_ptr<Operations>& operations, std::function<void(std::shared_ptr<Error>)>&& callback) :
+				_operations(operations),
+				_callback(std::move(callback)),
+				_completed(false),
+				_trace_start(CRTC_TRACE_NOW()),
+				_queued(MetricsRegistry::Now())
 			{ }
 
-			~SetLocalDescriptionObserver() override { }
+			~SetDescriptionObserver() override {
+				if (!_completed) {
+					Complete(Error::New("RTCPeerConnection closed before the operation completed", __FILE__, __LINE__));
+				}
+			}
+
+			RTCPeerConnectionInternal* Connection() const {
+				return _operations->pc;
+			}
+
+			void Complete(std::shared_ptr<Error> error) {
+				_completed = true;
+
+				CRTC_TRACE_SPAN("sdp", "SetLocalDescription/SetRemoteDescription", _trace_start);
+				MetricsRegistry::Add(MetricsRegistry::kSdpOperations);
+				MetricsRegistry::Record(MetricsRegistry::kSdpOperationLatency, _queued);
+
+				if (_callback) {
+					Async::Call(_operations->executor, [callback = std::move(_callback), error = std::move(error)]() {
+						callback(error);
+					});
+				}
+
+				_operations->Complete();
+			}
 
 		private:
 			void OnSetLocalDescriptionComplete(webrtc::RTCError error) override {
-				if(error.ok())
-					_resolve();
-				else
-					_reject(Error::New(error.message(), __FILE__, __LINE__));
+				if (error.ok() && Connection()) {
+					Connection()->UpdateDecodeSwitches();
+				}
+
+				Complete(error.ok() ? nullptr : Error::New(error.message(), __FILE__, __LINE__));
+			}
+
+			void OnSetRemoteDescriptionComplete(webrtc::RTCError error) override {
+				// Called on the signaling thread, where the connection clears Operations::pc before it goes away.
+				if (error.ok() && Connection()) {
+					Connection()->ApplyPendingIceCandidates();
+					Connection()->UpdateDecodeSwitches();
+				}
+				else if (Connection()) {
+					Connection()->FailPendingIceCandidates(Error::New("Remote description failed, candidates were not applied", __FILE__, __LINE__));
+				}
+
+				Complete(error.ok() ? nullptr : Error::New(error.message(), __FILE__, __LINE__));
 			}
 
-			Promise<>::FullFilledCallback _resolve;
-			Promise<>::RejectedCallback _reject;
+			std::shared_ptr<Operations> _operations;
+			std::function<void(std::shared_ptr<Error>)> _callback;
+			bool _completed;
+			int64_t _trace_start;
+			int64_t _queued;
+			Event _event;
 		};
 
-		class SetRemoteDescriptionObserver : public webrtc::SetRemoteDescriptionObserverInterface {
-		public:
-			SetRemoteDescriptionObserver(const Promise<>::FullFilledCallback& resolve,
-				const Promise<>::RejectedCallback& reject) :
-				_resolve(resolve),
-				_reject(reject)
-			{ }
+		// Completion state shared by the candidates of one AddIceCandidates() call. Only touched on the signaling thread.
+		struct IceCandidateBatch {
+			std::function<void(std::shared_ptr<Error>)> callback;
+			std::shared_ptr<Executor> executor;
+			std::shared_ptr<Error> error;
+			size_t remaining;
 
-			~SetRemoteDescriptionObserver() override { }
+			void Complete(const std::shared_ptr<Error>& result) {
+				if (result && !error) {
+					error = result;
+				}
 
-		private:
-			void OnSetRemoteDescriptionComplete(webrtc::RTCError error) override {
-				if (error.ok())
-					_resolve();
-				else
-					_reject(Error::New(error.message(), __FILE__, __LINE__));
+				if (!--remaining && callback) {
+					Async::Call(executor, [callback = std::move(callback), error = error]() { callback(error); });
+				}
 			}
+		};
 
-			Promise<>::FullFilledCallback _resolve;
-			Promise<>::RejectedCallback _reject;
+		struct PendingIceCandidate {
+			std::unique_ptr<webrtc::IceCandidateInterface> candidate;
+			std::shared_ptr<IceCandidateBatch> batch;
 		};
 
+		void ApplyIceCandidate(std::unique_ptr<webrtc::IceCandidateInterface> candidate, const std::shared_ptr<IceCandidateBatch>& batch);
+		void ConfigureRelaySender(const rtc::scoped_refptr<webrtc::RtpSenderInterface>& sender, VideoRelaySource* source);
+		void ApplyPendingIceCandidates();
+		// Signaling thread only. Completes the batches of candidates that can no longer be applied.
+		void FailPendingIceCandidates(const std::shared_ptr<Error>& error);
+		void StopRecorder();
+		void UpdateDecodeSwitches();
+		// Called with _bypass_mutex held.
+		bool BypassesVideo() const;
+		bool BypassesAudio() const;
+
 		std::unique_ptr<rtc::Thread> _network_thread;
 		std::unique_ptr<rtc::Thread> _worker_thread;
 		std::unique_ptr<rtc::Thread> _signal_thread;
@@ -319,6 +477,22 @@ namespace crtc {
 		//rtc::scoped_refptr<webrtc::AudioDeviceModule> _audio_device;
 		rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _factory;
 
+		// Owned by _factory, null for data channel only connections.
+		CustomVideoEncoderFactory* _video_encoder_factory;
+		bool _data_only;
+
+		// Guards the relay, the recorder and the decode switches, read by the decoding threads.
+		std::mutex _bypass_mutex;
+		rtc::scoped_refptr<VideoRelaySource> _relay_source;
+		std::shared_ptr<MediaStreamTrack> _relay_track;
+		std::shared_ptr<RTCRecorderInternal> _recorder;
+		std::map<uint32_t, std::shared_ptr<DecodeSwitch>> _video_ssrcs;
+		std::vector<std::shared_ptr<DecodeSwitch>> _video_switches;
+		std::vector<std::shared_ptr<DecodeSwitch>> _audio_switches;
+		// Whether _onRawVideo/_onRawAudio are set, saves the decoders their mutex on every frame.
+		bool _raw_video;
+		bool _raw_audio;
+
 	protected:
 		void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override;
 		void OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) override;
@@ -338,9 +512,10 @@ namespace crtc {
 
 		rtc::scoped_refptr<webrtc::PeerConnectionInterface> _socket;
 		std::shared_ptr<Event> _event;
-		std::vector<std::function<void()>> _pending_candidates;
+		std::shared_ptr<Executor> _executor;
+		std::vector<PendingIceCandidate> _pending_candidates;
 		std::vector<std::shared_ptr<MediaStreamInternal>> _streams;
-		bool _settingLocalDesc, _settingRemoteDesc;
+		std::shared_ptr<Operations> _operations;
 
 		synchronized_callback<> _onnegotiationneeded;
 		synchronized_callback<> _onsignalingstatechange;
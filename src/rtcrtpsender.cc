@@ -0,0 +1,119 @@
+#include "rtcrtpsender.h"
+#include "mediastreamtrack.h"
+#include "event.h"
+
+using namespace crtc;
+
+RTCRtpSenderInternal::RTCRtpSenderInternal(rtc::scoped_refptr<webrtc::RtpSenderInterface> sender, std::shared_ptr<Executor> executor, std::shared_ptr<MediaStreamTrack> track) :
+	_sender(std::move(sender)),
+	_executor(std::move(executor)),
+	_track(std::move(track))
+{ }
+
+RTCRtpSenderInternal::~RTCRtpSenderInternal() {
+
+}
+
+std::shared_ptr<MediaStreamTrack> RTCRtpSenderInternal::Track() const {
+	auto track = _sender->track();
+
+	if (!track) {
+		return nullptr;
+	}
+
+	auto internal = std::dynamic_pointer_cast<MediaStreamTrackInternal>(_track);
+
+	if (internal && internal->GetTrack() == track) {
+		return _track;
+	}
+
+	return std::make_shared<MediaStreamTrackInternal>(track.get());
+}
+
+RTCPeerConnection::RTCRtpSendParameters RTCRtpSenderInternal::GetParameters() const {
+	RTCPeerConnection::RTCRtpSendParameters parameters;
+
+	for (const auto& encoding : _sender->GetParameters().encodings) {
+		RTCPeerConnection::RTCRtpEncodingParameters result;
+
+		result.rid = encoding.rid.c_str();
+		result.active = encoding.active;
+		result.maxBitrate = encoding.max_bitrate_bps.value_or(0);
+		result.maxFramerate = encoding.max_framerate.value_or(0);
+		result.scaleResolutionDownBy = encoding.scale_resolution_down_by.value_or(0);
+		result.scalabilityMode = encoding.scalability_mode.value_or("").c_str();
+
+		parameters.encodings.push_back(result);
+	}
+
+	return parameters;
+}
+
+void RTCRtpSenderInternal::SetParameters(const RTCPeerConnection::RTCRtpSendParameters& parameters, std::function<void(std::shared_ptr<Error>)> callback) {
+	// Starts from the current parameters, WebRTC rejects any without its transaction id and codec state.
+	webrtc::RtpParameters current = _sender->GetParameters();
+	std::shared_ptr<Error> error;
+
+	if (parameters.encodings.size() != current.encodings.size()) {
+		error = Error::New("The number of encodings can not change without renegotiation", __FILE__, __LINE__);
+	}
+
+	for (size_t index = 0; !error && index < current.encodings.size(); index++) {
+		const auto& encoding = parameters.encodings[index];
+		auto& target = current.encodings[index];
+
+		if (target.rid != encoding.rid.c_str()) {
+			error = Error::New("Encoding rids can not change without renegotiation", __FILE__, __LINE__);
+			break;
+		}
+
+		ApplyEncoding(encoding, _sender->media_type() == cricket::MEDIA_TYPE_VIDEO, &target);
+	}
+
+	if (error) {
+		if (callback) {
+			Async::Call(_executor, [callback = std::move(callback), error]() { callback(error); });
+		}
+
+		return;
+	}
+
+	_sender->SetParametersAsync(current, [executor = _executor, callback = std::move(callback), event = Event::New()](webrtc::RTCError result) mutable {
+		if (!callback) {
+			return;
+		}
+
+		std::shared_ptr<Error> error = result.ok() ? nullptr : Error::New(result.message(), __FILE__, __LINE__);
+
+		Async::Call(executor, [callback = std::move(callback), error = std::move(error), event = std::move(event)]() {
+			callback(error);
+		});
+	});
+}
+
+rtc::scoped_refptr<webrtc::RtpSenderInterface> RTCRtpSenderInternal::Sender() const {
+	return _sender;
+}
+
+void RTCRtpSenderInternal::ApplyEncoding(const RTCPeerConnection::RTCRtpEncodingParameters& encoding, bool video, webrtc::RtpEncodingParameters* target) {
+	target->active = encoding.active;
+	target->max_bitrate_bps = encoding.maxBitrate ? absl::optional<int>(encoding.maxBitrate) : absl::nullopt;
+	target->max_framerate = (encoding.maxFramerate > 0) ? absl::optional<double>(encoding.maxFramerate) : absl::nullopt;
+
+	// WebRTC rejects resolution and scalability settings on audio encodings.
+	if (video) {
+		target->scale_resolution_down_by = (encoding.scaleResolutionDownBy > 0) ? absl::optional<double>(encoding.scaleResolutionDownBy) : absl::nullopt;
+		target->scalability_mode = encoding.scalabilityMode.size() ? absl::optional<std::string>(encoding.scalabilityMode.c_str()) : absl::nullopt;
+	}
+}
+
+std::vector<webrtc::RtpEncodingParameters> RTCRtpSenderInternal::ToEncodings(const std::vector<RTCPeerConnection::RTCRtpEncodingParameters>& encodings, bool video) {
+	std::vector<webrtc::RtpEncodingParameters> result(encodings.size());
+
+	for (size_t index = 0; index < encodings.size(); index++) {
+		result[index].rid = encodings[index].rid.c_str();
+		ApplyEncoding(encodings[index], video, &result[index]);
+	}
+
+	return result;
+}
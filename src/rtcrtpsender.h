@@ -0,0 +1,32 @@
+#ifndef CRTC_RTCRTPSENDER_H
+#define CRTC_RTCRTPSENDER_H
+
+#include "crtc.h"
+#include <api/rtp_sender_interface.h>
+
+namespace crtc {
+	class RTCRtpSenderInternal : public RTCPeerConnection::RTCRtpSender {
+	public:
+		// track is the wrapper given to AddTrack(), senders found later wrap the WebRTC track themselves.
+		explicit RTCRtpSenderInternal(rtc::scoped_refptr<webrtc::RtpSenderInterface> sender, std::shared_ptr<Executor> executor, std::shared_ptr<MediaStreamTrack> track = nullptr);
+		~RTCRtpSenderInternal() override;
+
+		std::shared_ptr<MediaStreamTrack> Track() const override;
+
+		RTCPeerConnection::RTCRtpSendParameters GetParameters() const override;
+		void SetParameters(const RTCPeerConnection::RTCRtpSendParameters& parameters, std::function<void(std::shared_ptr<Error>)> callback) override;
+
+		rtc::scoped_refptr<webrtc::RtpSenderInterface> Sender() const;
+
+		// Copies everything but the rid, which only negotiation may set.
+		static void ApplyEncoding(const RTCPeerConnection::RTCRtpEncodingParameters& encoding, bool video, webrtc::RtpEncodingParameters* target);
+		static std::vector<webrtc::RtpEncodingParameters> ToEncodings(const std::vector<RTCPeerConnection::RTCRtpEncodingParameters>& encodings, bool video);
+
+	private:
+		rtc::scoped_refptr<webrtc::RtpSenderInterface> _sender;
+		std::shared_ptr<Executor> _executor;
+		std::shared_ptr<MediaStreamTrack> _track;
+	};
+}
+
+#endif
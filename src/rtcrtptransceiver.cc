@@ -0,0 +1,81 @@
+#include "rtcrtptransceiver.h"
+#include "rtcrtpsender.h"
+
+using namespace crtc;
+
+RTCRtpTransceiverInternal::RTCRtpTransceiverInternal(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver, std::shared_ptr<Executor> executor, std::shared_ptr<MediaStreamTrack> track) :
+	_transceiver(std::move(transceiver)),
+	_sender(std::make_shared<RTCRtpSenderInternal>(_transceiver->sender(), std::move(executor), std::move(track)))
+{ }
+
+RTCRtpTransceiverInternal::~RTCRtpTransceiverInternal() {
+
+}
+
+String RTCRtpTransceiverInternal::Mid() const {
+	auto mid = _transceiver->mid();
+	return mid ? String(mid->c_str()) : String();
+}
+
+MediaStreamTrack::Type RTCRtpTransceiverInternal::Kind() const {
+	return (_transceiver->media_type() == cricket::MEDIA_TYPE_AUDIO) ? MediaStreamTrack::kAudio : MediaStreamTrack::kVideo;
+}
+
+std::shared_ptr<RTCPeerConnection::RTCRtpSender> RTCRtpTransceiverInternal::Sender() const {
+	return _sender;
+}
+
+RTCPeerConnection::RTCRtpTransceiverDirection RTCRtpTransceiverInternal::Direction() const {
+	return FromDirection(_transceiver->direction());
+}
+
+RTCPeerConnection::RTCRtpTransceiverDirection RTCRtpTransceiverInternal::CurrentDirection() const {
+	auto direction = _transceiver->current_direction();
+	return direction ? FromDirection(*direction) : RTCPeerConnection::kInactive;
+}
+
+bool RTCRtpTransceiverInternal::SetDirection(RTCPeerConnection::RTCRtpTransceiverDirection direction) {
+	if (direction == RTCPeerConnection::kStopped) {
+		return false;
+	}
+
+	return _transceiver->SetDirectionWithError(ToDirection(direction)).ok();
+}
+
+void RTCRtpTransceiverInternal::Stop() {
+	_transceiver->StopStandard();
+}
+
+rtc::scoped_refptr<webrtc::RtpTransceiverInterface> RTCRtpTransceiverInternal::Transceiver() const {
+	return _transceiver;
+}
+
+webrtc::RtpTransceiverDirection RTCRtpTransceiverInternal::ToDirection(RTCPeerConnection::RTCRtpTransceiverDirection direction) {
+	switch (direction) {
+		case RTCPeerConnection::kSendOnly:
+			return webrtc::RtpTransceiverDirection::kSendOnly;
+		case RTCPeerConnection::kRecvOnly:
+			return webrtc::RtpTransceiverDirection::kRecvOnly;
+		case RTCPeerConnection::kInactive:
+			return webrtc::RtpTransceiverDirection::kInactive;
+		case RTCPeerConnection::kStopped:
+			return webrtc::RtpTransceiverDirection::kStopped;
+		default:
+			return webrtc::RtpTransceiverDirection::kSendRecv;
+	}
+}
+
+RTCPeerConnection::RTCRtpTransceiverDirection RTCRtpTransceiverInternal::FromDirection(webrtc::RtpTransceiverDirection direction) {
+	switch (direction) {
+		case webrtc::RtpTransceiverDirection::kSendOnly:
+			return RTCPeerConnection::kSendOnly;
+		case webrtc::RtpTransceiverDirection::kRecvOnly:
+			return RTCPeerConnection::kRecvOnly;
+		case webrtc::RtpTransceiverDirection::kInactive:
+			return RTCPeerConnection::kInactive;
+		case webrtc::RtpTransceiverDirection::kStopped:
+			return RTCPeerConnection::kStopped;
+		default:
+			return RTCPeerConnection::kSendRecv;
+	}
+}
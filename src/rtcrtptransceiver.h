@@ -0,0 +1,36 @@
+#ifndef CRTC_RTCRTPTRANSCEIVER_H
+#define CRTC_RTCRTPTRANSCEIVER_H
+
+#include "crtc.h"
+#include <api/rtp_transceiver_interface.h>
+
+namespace crtc {
+	// WebRTC proxies every transceiver call to the signaling thread, so any thread may use it.
+	class RTCRtpTransceiverInternal : public RTCPeerConnection::RTCRtpTransceiver {
+	public:
+		explicit RTCRtpTransceiverInternal(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver, std::shared_ptr<Executor> executor, std::shared_ptr<MediaStreamTrack> track = nullptr);
+		~RTCRtpTransceiverInternal() override;
+
+		String Mid() const override;
+		MediaStreamTrack::Type Kind() const override;
+
+		std::shared_ptr<RTCPeerConnection::RTCRtpSender> Sender() const override;
+
+		RTCPeerConnection::RTCRtpTransceiverDirection Direction() const override;
+		RTCPeerConnection::RTCRtpTransceiverDirection CurrentDirection() const override;
+		bool SetDirection(RTCPeerConnection::RTCRtpTransceiverDirection direction) override;
+
+		void Stop() override;
+
+		rtc::scoped_refptr<webrtc::RtpTransceiverInterface> Transceiver() const;
+
+		static webrtc::RtpTransceiverDirection ToDirection(RTCPeerConnection::RTCRtpTransceiverDirection direction);
+		static RTCPeerConnection::RTCRtpTransceiverDirection FromDirection(webrtc::RtpTransceiverDirection direction);
+
+	private:
+		rtc::scoped_refptr<webrtc::RtpTransceiverInterface> _transceiver;
+		std::shared_ptr<RTCPeerConnection::RTCRtpSender> _sender;
+	};
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "rtcstats.h"
+#include <cstring>
+
+using namespace crtc;
+
+namespace {
+	// Works for both absl::optional members and the older webrtc::RTCStatsMember.
+	template <typename T, typename M> inline void Read(T& value, const M& member) {
+		if (member.has_value()) {
+			value = static_cast<T>(*member);
+		}
+	}
+
+	template <typename M> inline void ReadKind(RTCPeerConnection::RTCStats::RTCMediaKind& kind, const M& member) {
+		if (member.has_value()) {
+			if (*member == "audio") {
+				kind = RTCPeerConnection::RTCStats::kAudio;
+			}
+			else if (*member == "video") {
+				kind = RTCPeerConnection::RTCStats::kVideo;
+			}
+		}
+	}
+}
+
+RTCStatsCollector::RTCStatsCollector(std::shared_ptr<Executor> executor, std::function<void(std::shared_ptr<Error>, const RTCPeerConnection::RTCStatsReport&)>&& callback, bool cheap) :
+	_executor(std::move(executor)),
+	_callback(std::move(callback)),
+	_cheap(cheap)
+{ }
+
+RTCStatsCollector::~RTCStatsCollector() {
+	if (_callback) {
+		Deliver(Error::New("RTCPeerConnection closed before the stats were delivered", __FILE__, __LINE__), RTCPeerConnection::RTCStatsReport());
+	}
+}
+
+void RTCStatsCollector::Fail(std::shared_ptr<Error> error) {
+	Deliver(std::move(error), RTCPeerConnection::RTCStatsReport());
+}
+
+void RTCStatsCollector::OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+	RTCPeerConnection::RTCStatsReport result;
+
+	if (!report) {
+		Fail(Error::New("Failed to collect stats", __FILE__, __LINE__));
+		return;
+	}
+
+	result.reserve(report->size());
+
+	for (const webrtc::RTCStats& stats : *report) {
+		const char* type = stats.type();
+
+		if (!std::strcmp(type, webrtc::RTCInboundRtpStreamStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kInboundRtp, result);
+		}
+		else if (!std::strcmp(type, webrtc::RTCOutboundRtpStreamStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kOutboundRtp, result);
+		}
+		else if (!std::strcmp(type, webrtc::RTCRemoteInboundRtpStreamStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kRemoteInboundRtp, result);
+		}
+		else if (!std::strcmp(type, webrtc::RTCTransportStats::kType)) {
+			if (_cheap) {
+				// Only the selected pair of each transport is reported, the others are skipped below.
+				const auto& transport = stats.cast_to<webrtc::RTCTransportStats>();
+
+				if (transport.selected_candidate_pair_id.has_value()) {
+					const webrtc::RTCStats* pair = report->Get(*transport.selected_candidate_pair_id);
+
+					if (pair) {
+						Append(*pair, RTCPeerConnection::RTCStats::kCandidatePair, result);
+					}
+				}
+			}
+			else {
+				Append(stats, RTCPeerConnection::RTCStats::kTransport, result);
+			}
+		}
+		else if (!std::strcmp(type, webrtc::RTCDataChannelStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kDataChannel, result);
+		}
+		else if (_cheap) {
+			continue;
+		}
+		else if (!std::strcmp(type, webrtc::RTCCandidatePairStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kCandidatePair, result);
+		}
+		else if (!std::strcmp(type, webrtc::RTCPeerConnectionStats::kType)) {
+			Append(stats, RTCPeerConnection::RTCStats::kPeerConnection, result);
+		}
+	}
+
+	Deliver(nullptr, std::move(result));
+}
+
+void RTCStatsCollector::Deliver(std::shared_ptr<Error> error, RTCPeerConnection::RTCStatsReport&& report) {
+	if (!_callback) {
+		return;
+	}
+
+	Async::Call(_executor, [callback = std::move(_callback), error = std::move(error), report = std::move(report)]() {
+		callback(error, report);
+	});
+
+	_callback = nullptr;
+}
+
+void RTCStatsCollector::Append(const webrtc::RTCStats& stats, RTCPeerConnection::RTCStats::RTCStatsType type, RTCPeerConnection::RTCStatsReport& report) const {
+	report.emplace_back(type);
+
+	RTCPeerConnection::RTCStats& record = report.back();
+	record.timestampUs = stats.timestamp().us();
+
+	if (!_cheap) {
+		record.id = stats.id().c_str();
+	}
+
+	switch (type) {
+		case RTCPeerConnection::RTCStats::kInboundRtp: {
+			const auto& inbound = stats.cast_to<webrtc::RTCInboundRtpStreamStats>();
+
+			ReadKind(record.kind, inbound.kind);
+			Read(record.ssrc, inbound.ssrc);
+			Read(record.packetsReceived, inbound.packets_received);
+			Read(record.bytesReceived, inbound.bytes_received);
+			Read(record.packetsLost, inbound.packets_lost);
+			Read(record.jitter, inbound.jitter);
+			Read(record.framesDecoded, inbound.frames_decoded);
+			Read(record.keyFramesDecoded, inbound.key_frames_decoded);
+			Read(record.framesDropped, inbound.frames_dropped);
+			Read(record.framesPerSecond, inbound.frames_per_second);
+
+			if (!_cheap && inbound.track_identifier.has_value()) {
+				record.trackId = inbound.track_identifier->c_str();
+			}
+
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kOutboundRtp: {
+			const auto& outbound = stats.cast_to<webrtc::RTCOutboundRtpStreamStats>();
+
+			ReadKind(record.kind, outbound.kind);
+			Read(record.ssrc, outbound.ssrc);
+			Read(record.packetsSent, outbound.packets_sent);
+			Read(record.bytesSent, outbound.bytes_sent);
+			Read(record.targetBitrate, outbound.target_bitrate);
+			Read(record.framesEncoded, outbound.frames_encoded);
+			Read(record.keyFramesEncoded, outbound.key_frames_encoded);
+			Read(record.framesPerSecond, outbound.frames_per_second);
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kRemoteInboundRtp: {
+			const auto& remote = stats.cast_to<webrtc::RTCRemoteInboundRtpStreamStats>();
+
+			ReadKind(record.kind, remote.kind);
+			Read(record.ssrc, remote.ssrc);
+			Read(record.packetsLost, remote.packets_lost);
+			Read(record.fractionLost, remote.fraction_lost);
+			Read(record.jitter, remote.jitter);
+			Read(record.roundTripTime, remote.round_trip_time);
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kCandidatePair: {
+			const auto& pair = stats.cast_to<webrtc::RTCCandidatePairStats>();
+
+			Read(record.packetsSent, pair.packets_sent);
+			Read(record.packetsReceived, pair.packets_received);
+			Read(record.bytesSent, pair.bytes_sent);
+			Read(record.bytesReceived, pair.bytes_received);
+			Read(record.roundTripTime, pair.current_round_trip_time);
+			Read(record.availableOutgoingBitrate, pair.available_outgoing_bitrate);
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kTransport: {
+			const auto& transport = stats.cast_to<webrtc::RTCTransportStats>();
+
+			Read(record.packetsSent, transport.packets_sent);
+			Read(record.packetsReceived, transport.packets_received);
+			Read(record.bytesSent, transport.bytes_sent);
+			Read(record.bytesReceived, transport.bytes_received);
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kDataChannel: {
+			const auto& channel = stats.cast_to<webrtc::RTCDataChannelStats>();
+
+			Read(record.messagesSent, channel.messages_sent);
+			Read(record.messagesReceived, channel.messages_received);
+			Read(record.bytesSent, channel.bytes_sent);
+			Read(record.bytesReceived, channel.bytes_received);
+			break;
+		}
+		case RTCPeerConnection::RTCStats::kPeerConnection: {
+			const auto& connection = stats.cast_to<webrtc::RTCPeerConnectionStats>();
+
+			Read(record.dataChannelsOpened, connection.data_channels_opened);
+			Read(record.dataChannelsClosed, connection.data_channels_closed);
+			break;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef CRTC_RTCSTATS_H
+#define CRTC_RTCSTATS_H
+
+#include "crtc.h"
+#include "event.h"
+#include <api/stats/rtc_stats_collector_callback.h>
+#include <api/stats/rtcstats_objects.h>
+
+namespace crtc {
+	// Flattens a WebRTC stats report on the signaling thread and hands the result to the executor.
+	// Only the types and members mapped by RTCPeerConnection::RTCStats are read, the report is never serialized.
+	class RTCStatsCollector : public webrtc::RTCStatsCollectorCallback {
+	public:
+		RTCStatsCollector(std::shared_ptr<Executor> executor, std::function<void(std::shared_ptr<Error>, const RTCPeerConnection::RTCStatsReport&)>&& callback, bool cheap);
+		~RTCStatsCollector() override;
+
+		void Fail(std::shared_ptr<Error> error);
+
+	private:
+		void OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) override;
+		void Deliver(std::shared_ptr<Error> error, RTCPeerConnection::RTCStatsReport&& report);
+		void Append(const webrtc::RTCStats& stats, RTCPeerConnection::RTCStats::RTCStatsType type, RTCPeerConnection::RTCStatsReport& report) const;
+
+		std::shared_ptr<Executor> _executor;
+		std::function<void(std::shared_ptr<Error>, const RTCPeerConnection::RTCStatsReport&)> _callback;
+		bool _cheap;
+		Event _event;
+	};
+}
+
+#endif
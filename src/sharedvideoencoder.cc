@@ -0,0 +1,262 @@
+#include "sharedvideoencoder.h"
+#include "api/video_codecs/video_codec.h"
+#include "rtc_base/time_utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace crtc;
+
+// One codec per group and configuration. Codecs in this library call back from inside Encode(), so the
+// callbacks run with the mutex held.
+struct SharedVideoEncoder::Codec : public webrtc::EncodedImageCallback {
+	~Codec() override {
+		encoder->Release();
+	}
+
+	Result OnEncodedImage(const webrtc::EncodedImage& image, const webrtc::CodecSpecificInfo* info) override {
+		if (image._frameType == webrtc::VideoFrameType::kVideoFrameKey) {
+			lastKeyFrameMs = rtc::TimeMillis();
+		}
+
+		Result result(Result::ERROR_SEND_FAILED);
+
+		for (SharedVideoEncoder* subscriber : subscribers) {
+			if (subscriber->_callback) {
+				Result sent = subscriber->_callback->OnEncodedImage(image, info);
+
+				if (sent.error == Result::OK) {
+					result = sent;
+				}
+			}
+		}
+
+		return result;
+	}
+
+	void OnDroppedFrame(DropReason reason) override {
+		for (SharedVideoEncoder* subscriber : subscribers) {
+			if (subscriber->_callback) {
+				subscriber->_callback->OnDroppedFrame(reason);
+			}
+		}
+	}
+
+	// Every subscriber gets the same stream, it is sized for the one with the least bandwidth.
+	// Subscribers that are paused or have no estimate yet are left out.
+	void UpdateRates(const RateControlParameters& fallback) {
+		const RateControlParameters* lowest = nullptr;
+
+		for (SharedVideoEncoder* subscriber : subscribers) {
+			uint32_t bitrate = subscriber->_rates.bitrate.get_sum_bps();
+
+			if (bitrate && (!lowest || bitrate < lowest->bitrate.get_sum_bps())) {
+				lowest = &subscriber->_rates;
+			}
+		}
+
+		encoder->SetRates(lowest ? *lowest : fallback);
+	}
+
+	std::mutex mutex;
+	std::unique_ptr<webrtc::VideoEncoder> encoder;
+	std::vector<SharedVideoEncoder*> subscribers;
+	size_t streams = 1;
+	int64_t lastFrameUs = -1;
+	int64_t lastKeyFrameMs = -1;
+	bool keyFrameRequested = false;
+};
+
+namespace {
+	std::mutex codecsMutex;
+	std::map<std::string, std::weak_ptr<SharedVideoEncoder::Codec>> codecs;
+
+	// Everything an encoder is initialized with that changes its output.
+	std::string Configuration(const webrtc::VideoCodec& codec, const webrtc::VideoEncoder::Settings& settings) {
+		auto scalability = codec.GetScalabilityMode();
+		char buffer[160];
+
+		snprintf(buffer, sizeof(buffer), "/%d:%ux%u@%u:%u-%u:qp%u:m%d:s%d:p%zu",
+			static_cast<int>(codec.codecType), codec.width, codec.height, codec.maxFramerate, codec.minBitrate, codec.maxBitrate,
+			codec.qpMax, static_cast<int>(codec.mode), scalability ? static_cast<int>(*scalability) : -1, settings.max_payload_size);
+
+		std::string configuration(buffer);
+
+		for (int index = 0; index < codec.numberOfSimulcastStreams; index++) {
+			const webrtc::SimulcastStream& stream = codec.simulcastStream[index];
+
+			snprintf(buffer, sizeof(buffer), "/%ux%u@%g:t%u:%u:%d",
+				stream.width, stream.height, stream.maxFramerate, stream.numberOfTemporalLayers, stream.maxBitrate, stream.active ? 1 : 0);
+
+			configuration += buffer;
+		}
+
+		return configuration;
+	}
+}
+
+SharedVideoEncoder::SharedVideoEncoder(const std::string& group, std::function<std::unique_ptr<webrtc::VideoEncoder>()> create, int keyFrameIntervalMs) :
+	_group(group),
+	_create(std::move(create)),
+	_key_frame_interval_ms(keyFrameIntervalMs),
+	_callback(nullptr)
+{ }
+
+SharedVideoEncoder::~SharedVideoEncoder() {
+	Leave();
+}
+
+int32_t SharedVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings, const webrtc::VideoEncoder::Settings& settings) {
+	Leave();
+
+	if (!codec_settings) {
+		return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+	}
+
+	std::string key = _group + Configuration(*codec_settings, settings);
+	std::lock_guard<std::mutex> lock(codecsMutex);
+	std::shared_ptr<Codec> codec = codecs[key].lock();
+
+	if (codec) {
+		// Subscribed to a running codec, a spare is not needed anymore.
+		_encoder.reset();
+	} else {
+		if (!_encoder) {
+			_encoder = _create();
+		}
+
+		if (!_encoder) {
+			return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+		}
+
+		int32_t result = _encoder->InitEncode(codec_settings, settings);
+
+		if (result != WEBRTC_VIDEO_CODEC_OK) {
+			return result;
+		}
+
+		codec = std::make_shared<Codec>();
+		codec->encoder = std::move(_encoder);
+		codec->encoder->RegisterEncodeCompleteCallback(codec.get());
+		codec->streams = std::max(1, static_cast<int>(codec_settings->numberOfSimulcastStreams));
+
+		for (auto it = codecs.begin(); it != codecs.end();) {
+			it = it->second.expired() ? codecs.erase(it) : std::next(it);
+		}
+
+		codecs[key] = codec;
+	}
+
+	std::lock_guard<std::mutex> codecLock(codec->mutex);
+
+	// A new subscriber starts decoding with a key frame.
+	codec->subscribers.push_back(this);
+	codec->keyFrameRequested = true;
+	_codec = std::move(codec);
+
+	return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) {
+	std::unique_lock<std::mutex> lock;
+
+	if (_codec) {
+		lock = std::unique_lock<std::mutex>(_codec->mutex);
+	}
+
+	_callback = callback;
+
+	return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::Release() {
+	Leave();
+	return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::Encode(const webrtc::VideoFrame& frame, const std::vector<webrtc::VideoFrameType>* frame_types) {
+	if (!_codec) {
+		return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+	}
+
+	Codec& codec = *_codec;
+	std::lock_guard<std::mutex> lock(codec.mutex);
+
+	if (frame_types && std::find(frame_types->begin(), frame_types->end(), webrtc::VideoFrameType::kVideoFrameKey) != frame_types->end()) {
+		codec.keyFrameRequested = true;
+	}
+
+	// Every subscriber passes the same frames, whichever passes a frame first has it encoded for all of them.
+	if (frame.timestamp_us() <= codec.lastFrameUs) {
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	codec.lastFrameUs = frame.timestamp_us();
+
+	int64_t now = rtc::TimeMillis();
+	bool keyFrame = codec.keyFrameRequested && (codec.lastKeyFrameMs < 0 || now - codec.lastKeyFrameMs >= _key_frame_interval_ms);
+	std::vector<webrtc::VideoFrameType> types(frame_types ? frame_types->size() : codec.streams,
+		keyFrame ? webrtc::VideoFrameType::kVideoFrameKey : webrtc::VideoFrameType::kVideoFrameDelta);
+
+	if (keyFrame) {
+		codec.keyFrameRequested = false;
+		codec.lastKeyFrameMs = now;
+	}
+
+	return codec.encoder->Encode(frame, &types);
+}
+
+void SharedVideoEncoder::SetRates(const RateControlParameters& parameters) {
+	if (!_codec) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_codec->mutex);
+
+	_rates = parameters;
+	_codec->UpdateRates(parameters);
+}
+
+webrtc::VideoEncoder::EncoderInfo SharedVideoEncoder::GetEncoderInfo() const {
+	if (_codec) {
+		std::lock_guard<std::mutex> lock(_codec->mutex);
+		return _codec->encoder->GetEncoderInfo();
+	}
+
+	// Queried before the first InitEncode(), the encoder created here is the one that initializes.
+	if (!_info) {
+		if (!_encoder) {
+			_encoder = _create();
+		}
+
+		_info = _encoder ? _encoder->GetEncoderInfo() : EncoderInfo();
+	}
+
+	return *_info;
+}
+
+void SharedVideoEncoder::Leave() {
+	if (!_codec) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_codec->mutex);
+		auto& subscribers = _codec->subscribers;
+
+		subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), this), subscribers.end());
+
+		if (!subscribers.empty()) {
+			_codec->UpdateRates(RateControlParameters());
+		}
+
+		_rates = RateControlParameters();
+		_info = _codec->encoder->GetEncoderInfo();
+	}
+
+	// The last subscriber releases the codec.
+	_codec.reset();
+}
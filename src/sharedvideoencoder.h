@@ -0,0 +1,48 @@
+#ifndef CRTC_SHAREDVIDEOENCODER_H
+#define CRTC_SHAREDVIDEOENCODER_H
+
+#include "absl/types/optional.h"
+#include "api/video_codecs/video_encoder.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace crtc {
+	// Encoder handed to one connection of a broadcast group. Encoders of the group initialized with the same
+	// format and configuration subscribe to a single codec: the first of them to pass a frame encodes it, the
+	// others skip it, and every encoded image goes to all subscribers. Key frame requests are merged and sent
+	// to the codec at most once per key frame interval.
+	class SharedVideoEncoder : public webrtc::VideoEncoder {
+	public:
+		struct Codec;
+
+		SharedVideoEncoder(const std::string& group, std::function<std::unique_ptr<webrtc::VideoEncoder>()> create, int keyFrameIntervalMs);
+		~SharedVideoEncoder() override;
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings, const webrtc::VideoEncoder::Settings& settings) override;
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+		int32_t Release() override;
+		int32_t Encode(const webrtc::VideoFrame& frame, const std::vector<webrtc::VideoFrameType>* frame_types) override;
+		void SetRates(const RateControlParameters& parameters) override;
+		EncoderInfo GetEncoderInfo() const override;
+
+	private:
+		void Leave();
+
+		std::string _group;
+		std::function<std::unique_ptr<webrtc::VideoEncoder>()> _create;
+		int _key_frame_interval_ms;
+
+		// Not initialized, created on demand and becomes the shared codec when this encoder starts one.
+		mutable std::unique_ptr<webrtc::VideoEncoder> _encoder;
+		// Answers GetEncoderInfo() while no codec is subscribed.
+		mutable absl::optional<EncoderInfo> _info;
+		std::shared_ptr<Codec> _codec;
+
+		// Guarded by the codec's mutex once subscribed.
+		webrtc::EncodedImageCallback* _callback;
+		RateControlParameters _rates;
+	};
+}
+
+#endif
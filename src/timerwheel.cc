@@ -0,0 +1,289 @@
+#include "timerwheel.h"
+#include "module.h"
+#include <algorithm>
+#include <climits>
+
+using namespace crtc;
+
+TimerWheel::TimerWheel(int resolutionMs) :
+	_base(0),
+	_resolution(resolutionMs > 0 ? resolutionMs : 1),
+	_tick(0),
+	_wakeup(0),
+	_armed(0),
+	_count(0),
+	_shard(0)
+{
+	for (auto& level : _wheel) {
+		for (auto& slot : level) {
+			slot = kNil;
+		}
+	}
+}
+
+TimerWheel::~TimerWheel() {
+	for (uint32_t index = 0; index < _timers.size(); index++) {
+		if (_timers[index].list) {
+			Free(index);
+		}
+	}
+}
+
+void TimerWheel::SetResolution(int resolutionMs) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_count && resolutionMs > 0) {
+		_resolution = resolutionMs;
+	}
+}
+
+uint64_t TimerWheel::ToTick(int64_t ms) const {
+	return static_cast<uint64_t>((ms - _base + _resolution - 1) / _resolution);
+}
+
+uint64_t TimerWheel::Schedule(const std::shared_ptr<Executor>& executor, Task task, int delayMs) {
+	int64_t now = Time::Now();
+	int64_t deadline = 0;
+	uint64_t timeout = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (!_count) {
+			// Nothing to fire in between, so an idle wheel can jump straight to the present.
+			_base = now;
+			_tick = 0;
+			_wakeup = 0;
+		}
+
+		uint32_t index;
+
+		if (_free.empty()) {
+			index = static_cast<uint32_t>(_timers.size());
+			_timers.emplace_back();
+		}
+		else {
+			index = _free.back();
+			_free.pop_back();
+		}
+
+		Timer& timer = _timers[index];
+
+		timer.expires = std::max(ToTick(now + std::max(delayMs, 0)), _tick + 1);
+		timer.task = std::move(task);
+		timer.executor = executor;
+
+		Insert(index);
+
+		if (!_count++) {
+			_shard = ModuleInternal::pending_events.Acquire();
+		}
+
+		if (!_wakeup || timer.expires < _wakeup) {
+			_wakeup = timer.expires;
+		}
+
+		if (Arm(static_cast<int64_t>(timer.expires) * _resolution + _base)) {
+			deadline = _armed;
+		}
+
+		timeout = (static_cast<uint64_t>(timer.generation) << 32) | index;
+	}
+
+	if (deadline) {
+		// The dispatch loop may be blocked waiting for a later deadline, a delayed task ends its wait in time.
+		ModuleInternal::WakeTimers(static_cast<int>(std::max<int64_t>(deadline - now, 0)));
+	}
+
+	return timeout;
+}
+
+bool TimerWheel::Cancel(uint64_t timeout) {
+	Task task;
+	std::shared_ptr<Executor> executor;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		uint32_t index = static_cast<uint32_t>(timeout & 0xffffffff);
+		uint32_t generation = static_cast<uint32_t>(timeout >> 32);
+
+		if (index >= _timers.size() || _timers[index].generation != generation || !_timers[index].list) {
+			return false;
+		}
+
+		// Destroy the callback outside of the lock, it may schedule timers itself.
+		task = std::move(_timers[index].task);
+		executor = std::move(_timers[index].executor);
+
+		Unlink(index);
+		Free(index);
+	}
+
+	return true;
+}
+
+int TimerWheel::Advance(int64_t nowMs) {
+	std::vector<std::pair<std::shared_ptr<Executor>, Task>> expired;
+	int64_t next = -1;
+	bool arm = false;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		uint64_t target = (nowMs > _base) ? static_cast<uint64_t>((nowMs - _base) / _resolution) : 0;
+
+		if (!_count) {
+			_tick = std::max(_tick, target);
+			_wakeup = 0;
+			return -1;
+		}
+
+		while (_tick < target && _count) {
+			_tick++;
+
+			uint32_t slot = static_cast<uint32_t>(_tick & kMask);
+
+			for (int level = 1; level < kLevels && !slot; level++) {
+				slot = static_cast<uint32_t>((_tick >> (kBits * level)) & kMask);
+				Cascade(level, slot);
+			}
+
+			uint32_t* list = &_wheel[0][_tick & kMask];
+
+			while (*list != kNil) {
+				uint32_t index = *list;
+
+				expired.emplace_back(std::move(_timers[index].executor), std::move(_timers[index].task));
+				Unlink(index);
+				Free(index);
+			}
+		}
+
+		if (_count) {
+			_wakeup = _tick + NextTick();
+			next = std::max<int64_t>(static_cast<int64_t>(_wakeup) * _resolution + _base - nowMs, 0);
+			arm = Arm(static_cast<int64_t>(_wakeup) * _resolution + _base);
+		}
+		else {
+			_tick = std::max(_tick, target);
+			_wakeup = 0;
+		}
+	}
+
+	if (arm) {
+		ModuleInternal::WakeTimers(static_cast<int>(std::min<int64_t>(next, INT_MAX)));
+	}
+
+	for (auto& timer : expired) {
+		Async::Call(timer.first, std::move(timer.second));
+	}
+
+	return static_cast<int>(std::min<int64_t>(next, INT_MAX));
+}
+
+void TimerWheel::Fire() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// Whichever run fires first re-arms the wheel for the deadline left, stale runs only cost an Advance().
+		_armed = 0;
+	}
+
+	Advance(Time::Now());
+}
+
+// Called with the mutex held. True when the caller has to post a run for deadlineMs.
+bool TimerWheel::Arm(int64_t deadlineMs) {
+	if (_armed && _armed <= deadlineMs) {
+		return false;
+	}
+
+	_armed = deadlineMs;
+	return true;
+}
+
+void TimerWheel::Insert(uint32_t index) {
+	Timer& timer = _timers[index];
+	uint64_t delta = timer.expires - _tick;
+	uint64_t expires = timer.expires;
+	int level = 0;
+
+	while (level < kLevels - 1 && delta >= (static_cast<uint64_t>(1) << (kBits * (level + 1)))) {
+		level++;
+	}
+
+	if (delta >= (static_cast<uint64_t>(1) << (kBits * kLevels))) {
+		// Out of range, park in the furthest slot and re-evaluate when it cascades.
+		expires = _tick + (static_cast<uint64_t>(1) << (kBits * kLevels)) - 1;
+	}
+
+	uint32_t* list = &_wheel[level][(expires >> (kBits * level)) & kMask];
+
+	timer.list = list;
+	timer.prev = kNil;
+	timer.next = *list;
+
+	if (*list != kNil) {
+		_timers[*list].prev = index;
+	}
+
+	*list = index;
+}
+
+void TimerWheel::Unlink(uint32_t index) {
+	Timer& timer = _timers[index];
+
+	if (timer.prev != kNil) {
+		_timers[timer.prev].next = timer.next;
+	}
+	else {
+		*timer.list = timer.next;
+	}
+
+	if (timer.next != kNil) {
+		_timers[timer.next].prev = timer.prev;
+	}
+
+	timer.list = nullptr;
+	timer.prev = timer.next = kNil;
+}
+
+void TimerWheel::Free(uint32_t index) {
+	Timer& timer = _timers[index];
+
+	timer.list = nullptr;
+	timer.generation++;
+	timer.task.Reset();
+	timer.executor.reset();
+
+	_free.push_back(index);
+
+	if (!--_count) {
+		ModuleInternal::pending_events.Release(_shard);
+	}
+}
+
+void TimerWheel::Cascade(int level, uint32_t slot) {
+	uint32_t index = _wheel[level][slot];
+	_wheel[level][slot] = kNil;
+
+	while (index != kNil) {
+		uint32_t next = _timers[index].next;
+		Insert(index);
+		index = next;
+	}
+}
+
+int64_t TimerWheel::NextTick() const {
+	// Either the nearest occupied slot of the first level or the next cascade, whichever comes first.
+	uint64_t cascade = kSlots - (_tick & kMask);
+
+	for (uint64_t offset = 1; offset < cascade; offset++) {
+		if (_wheel[0][(_tick + offset) & kMask] != kNil) {
+			return static_cast<int64_t>(offset);
+		}
+	}
+
+	return static_cast<int64_t>(cascade);
+}
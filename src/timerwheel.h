@@ -0,0 +1,72 @@
+#ifndef CRTC_TIMERWHEEL_H
+#define CRTC_TIMERWHEEL_H
+
+#include "crtc.h"
+#include <mutex>
+
+namespace crtc {
+	// Hierarchical timing wheel: four levels of 64 slots, one tick per resolution. Timers falling
+	// into the same tick are fired together, so the resolution doubles as the coalescing slack.
+	// Timers live in a slab and are addressed by (generation << 32 | index) handles, which makes
+	// both Schedule() and Cancel() O(1). Expired timers are posted to their executor. The wheel posts a delayed
+	// run of itself to the module loop for its nearest deadline, a loop blocked in a longer wait still fires it.
+	class TimerWheel {
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator=(const TimerWheel&) = delete;
+
+	public:
+		explicit TimerWheel(int resolutionMs = 1);
+		~TimerWheel();
+
+		// Only takes effect while no timers are scheduled.
+		void SetResolution(int resolutionMs);
+
+		uint64_t Schedule(const std::shared_ptr<Executor>& executor, Task task, int delayMs);
+		bool Cancel(uint64_t timeout);
+
+		// Fires every timer due at nowMs. Returns milliseconds until the wheel needs to be advanced again, or -1 when it is empty.
+		int Advance(int64_t nowMs);
+
+		// The delayed run posted to the module loop.
+		void Fire();
+
+	private:
+		static const int kLevels = 4;
+		static const int kBits = 6;
+		static const uint32_t kSlots = 1 << kBits;
+		static const uint32_t kMask = kSlots - 1;
+		static const uint32_t kNil = 0xffffffff;
+
+		struct Timer {
+			uint64_t expires = 0;
+			uint32_t generation = 1;
+			uint32_t prev = kNil;
+			uint32_t next = kNil;
+			uint32_t* list = nullptr;
+			Task task;
+			std::shared_ptr<Executor> executor;
+		};
+
+		uint64_t ToTick(int64_t ms) const;
+		void Insert(uint32_t index);
+		void Unlink(uint32_t index);
+		void Free(uint32_t index);
+		void Cascade(int level, uint32_t slot);
+		int64_t NextTick() const;
+		bool Arm(int64_t deadlineMs);
+
+		std::mutex _mutex;
+		int64_t _base;
+		int64_t _resolution;
+		uint64_t _tick;
+		uint64_t _wakeup;
+		int64_t _armed;
+		size_t _count;
+		uint32_t _shard;
+		std::vector<Timer> _timers;
+		std::vector<uint32_t> _free;
+		uint32_t _wheel[kLevels][kSlots];
+	};
+}
+
+#endif
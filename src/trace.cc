@@ -0,0 +1,186 @@
+#include "trace.h"
+
+#ifdef CRTC_TRACING
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <rtc_base/thread.h>
+
+using namespace crtc;
+
+namespace {
+	const uint64_t kEvents = 1 << 16;
+
+	struct Event {
+		std::atomic<uint64_t> sequence;
+		std::atomic<const char*> category;
+		std::atomic<const char*> name;
+		std::atomic<int64_t> start;
+		std::atomic<int64_t> duration;
+		std::atomic<uint32_t> thread;
+	};
+
+	std::atomic<bool> tracing(false);
+	std::atomic<Event*> events(nullptr);
+	std::atomic<uint64_t> nextEvent(0);
+	std::atomic<uint32_t> nextThread(0);
+
+	std::mutex threadsMutex;
+	std::vector<std::pair<uint32_t, std::string>> threads;
+
+	int64_t Clock() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Threads are numbered on their first span and named after their rtc::Thread, when they have one.
+	uint32_t CurrentThread() {
+		thread_local uint32_t thread = 0;
+
+		if (!thread) {
+			thread = nextThread.fetch_add(1, std::memory_order_relaxed) + 1;
+
+			rtc::Thread* current = rtc::Thread::Current();
+			std::string name = (current && !current->name().empty()) ? current->name() : "thread " + std::to_string(thread);
+
+			std::lock_guard<std::mutex> lock(threadsMutex);
+			threads.emplace_back(thread, std::move(name));
+		}
+
+		return thread;
+	}
+}
+
+void Trace::Start() {
+	if (!events.load(std::memory_order_acquire)) {
+		// Allocated once and kept, spans recorded while stopping may still be writing to it.
+		Event* buffer = new Event[kEvents]();
+		Event* expected = nullptr;
+
+		if (!events.compare_exchange_strong(expected, buffer, std::memory_order_acq_rel)) {
+			delete[] buffer;
+		}
+	}
+
+	tracing.store(true, std::memory_order_release);
+}
+
+void Trace::Stop() {
+	tracing.store(false, std::memory_order_release);
+}
+
+int64_t Trace::Now() {
+	if (!tracing.load(std::memory_order_relaxed)) {
+		return 0;
+	}
+
+	return Clock();
+}
+
+void Trace::Record(const char* category, const char* name, int64_t startUs) {
+	Event* buffer = events.load(std::memory_order_acquire);
+
+	if (!startUs || !buffer) {
+		return;
+	}
+
+	int64_t end = Clock();
+	uint32_t thread = CurrentThread();
+	uint64_t index = nextEvent.fetch_add(1, std::memory_order_relaxed);
+	Event& event = buffer[index % kEvents];
+
+	// Odd while the slot is written, Dump() drops slots whose sequence changed while it was read.
+	event.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	event.category.store(category, std::memory_order_relaxed);
+	event.name.store(name, std::memory_order_relaxed);
+	event.start.store(startUs, std::memory_order_relaxed);
+	event.duration.store(end - startUs, std::memory_order_relaxed);
+	event.thread.store(thread, std::memory_order_relaxed);
+
+	event.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+std::string Trace::Dump() {
+	std::string json = "{\"traceEvents\":[";
+	Event* buffer = events.load(std::memory_order_acquire);
+	char line[256];
+	bool first = true;
+
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+
+		for (const auto& thread : threads) {
+			json += first ? "" : ",";
+			json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread.first) + ",\"args\":{\"name\":\"";
+
+			for (char c : thread.second) {
+				if (c == '"' || c == '\\') {
+					json += '\\';
+				}
+
+				json += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+			}
+
+			json += "\"}}";
+			first = false;
+		}
+	}
+
+	for (uint64_t index = 0; buffer && index < kEvents; index++) {
+		Event& event = buffer[index];
+		uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+
+		if (!sequence || (sequence & 1)) {
+			continue;
+		}
+
+		const char* category = event.category.load(std::memory_order_relaxed);
+		const char* name = event.name.load(std::memory_order_relaxed);
+		int64_t start = event.start.load(std::memory_order_relaxed);
+		int64_t duration = event.duration.load(std::memory_order_relaxed);
+		uint32_t thread = event.thread.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (event.sequence.load(std::memory_order_relaxed) != sequence) {
+			continue;
+		}
+
+		snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%u}",
+			first ? "" : ",", name, category, start, duration, thread);
+
+		json += line;
+		first = false;
+	}
+
+	json += "],\"displayTimeUnit\":\"ms\"}";
+	return json;
+}
+
+#else
+
+using namespace crtc;
+
+void Trace::Start() { }
+
+void Trace::Stop() { }
+
+std::string Trace::Dump() {
+	return "{\"traceEvents\":[]}";
+}
+
+int64_t Trace::Now() {
+	return 0;
+}
+
+void Trace::Record(const char* category, const char* name, int64_t startUs) {
+	(void)category;
+	(void)name;
+	(void)startUs;
+}
+
+#endif
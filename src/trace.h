@@ -0,0 +1,51 @@
+#ifndef CRTC_TRACE_H
+#define CRTC_TRACE_H
+
+#include "crtc.h"
+#include <string>
+
+// Spans are only compiled in with the CRTC_TRACING CMake option. Names and categories must be string literals.
+#ifdef CRTC_TRACING
+#define CRTC_TRACE_CONCAT_(a, b) a##b
+#define CRTC_TRACE_CONCAT(a, b) CRTC_TRACE_CONCAT_(a, b)
+#define CRTC_TRACE_SCOPE(category, name) ::crtc::Trace::Scope CRTC_TRACE_CONCAT(crtc_trace_, __LINE__)(category, name)
+#define CRTC_TRACE_NOW() ::crtc::Trace::Now()
+#define CRTC_TRACE_SPAN(category, name, start) ::crtc::Trace::Record(category, name, start)
+#else
+#define CRTC_TRACE_SCOPE(category, name)
+#define CRTC_TRACE_NOW() 0
+#define CRTC_TRACE_SPAN(category, name, start)
+#endif
+
+namespace crtc {
+	// Complete events ("ph":"X") are written to a fixed ring that overwrites the oldest spans. Each slot
+	// carries a sequence number, so Dump() skips slots that are being rewritten instead of locking writers.
+	class Trace {
+	public:
+		static void Start();
+		static void Stop();
+
+		// Chrome JSON trace format, loadable in chrome://tracing and ui.perfetto.dev.
+		static std::string Dump();
+
+		// Start time for Record(), 0 while tracing is stopped.
+		static int64_t Now();
+		static void Record(const char* category, const char* name, int64_t startUs);
+
+		class Scope {
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		public:
+			Scope(const char* category, const char* name) : _category(category), _name(name), _start(Now()) { }
+			~Scope() { Record(_category, _name, _start); }
+
+		private:
+			const char* _category;
+			const char* _name;
+			int64_t _start;
+		};
+	};
+}
+
+#endif
@@ -0,0 +1,490 @@
+#include "videorelay.h"
+#include "api/peer_connection_interface.h"
+#include "api/task_queue/default_task_queue_factory.h"
+#include "api/video/i420_buffer.h"
+#include "api/video_codecs/video_codec.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+#include "rtc_base/helpers.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+
+using namespace crtc;
+
+namespace {
+	// Sender clocks further off than this are followed by moving the relayed frames onto the local clock again.
+	const int64_t kResyncUs = 1000000;
+
+	// Every live relay buffer. An address in here can't belong to any other buffer.
+	std::mutex buffersMutex;
+	std::unordered_set<const webrtc::VideoFrameBuffer*> buffers;
+
+	// Media-less factory whose threads the relay track proxies are bound to. Subscribers can hold a relay track
+	// until the process exits, so it is never destroyed.
+	struct RelayFactory {
+		RelayFactory() :
+			signal_thread(rtc::Thread::Create()),
+			worker_thread(rtc::Thread::CreateWithSocketServer())
+		{
+			signal_thread->SetName("relay_signal", nullptr);
+			worker_thread->SetName("relay_worker", nullptr);
+
+			if (!signal_thread->Start() || !worker_thread->Start()) {
+				RTC_LOG(LS_ERROR) << "Failed to start the video relay threads";
+				return;
+			}
+
+			webrtc::PeerConnectionFactoryDependencies dependencies;
+
+			dependencies.network_thread = worker_thread.get();
+			dependencies.worker_thread = worker_thread.get();
+			dependencies.signaling_thread = signal_thread.get();
+			dependencies.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+
+			factory = webrtc::CreateModularPeerConnectionFactory(std::move(dependencies));
+		}
+
+		static RelayFactory& Instance() {
+			static RelayFactory* instance = new RelayFactory();
+			return *instance;
+		}
+
+		std::unique_ptr<rtc::Thread> signal_thread;
+		std::unique_ptr<rtc::Thread> worker_thread;
+		rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+	};
+
+	// What the packetizer needs to know about a frame it did not see encoded. Relayed streams are sent as a
+	// single layer without temporal layer information.
+	webrtc::CodecSpecificInfo CodecInfo(webrtc::VideoCodecType codec, bool keyFrame) {
+		webrtc::CodecSpecificInfo info;
+
+		info.codecType = codec;
+		info.end_of_picture = true;
+
+		switch (codec) {
+			case webrtc::kVideoCodecVP8:
+				info.codecSpecific.VP8.nonReference = false;
+				info.codecSpecific.VP8.temporalIdx = webrtc::kNoTemporalIdx;
+				info.codecSpecific.VP8.layerSync = false;
+				info.codecSpecific.VP8.keyIdx = webrtc::kNoKeyIdx;
+				break;
+			case webrtc::kVideoCodecVP9:
+				info.codecSpecific.VP9.first_frame_in_picture = true;
+				info.codecSpecific.VP9.inter_pic_predicted = !keyFrame;
+				info.codecSpecific.VP9.flexible_mode = false;
+				info.codecSpecific.VP9.ss_data_available = false;
+				info.codecSpecific.VP9.non_ref_for_inter_layer_pred = true;
+				info.codecSpecific.VP9.temporal_idx = webrtc::kNoTemporalIdx;
+				info.codecSpecific.VP9.temporal_up_switch = false;
+				info.codecSpecific.VP9.inter_layer_predicted = false;
+				info.codecSpecific.VP9.gof_idx = webrtc::kNoGofIdx;
+				info.codecSpecific.VP9.num_spatial_layers = 1;
+				info.codecSpecific.VP9.first_active_layer = 0;
+				info.codecSpecific.VP9.num_ref_pics = 0;
+				break;
+			case webrtc::kVideoCodecH264:
+				info.codecSpecific.H264.packetization_mode = webrtc::H264PacketizationMode::NonInterleaved;
+				info.codecSpecific.H264.temporal_idx = webrtc::kNoTemporalIdx;
+				info.codecSpecific.H264.base_layer_sync = false;
+				info.codecSpecific.H264.idr_frame = keyFrame;
+				break;
+			default:
+				break;
+		}
+
+		return info;
+	}
+}
+
+RelayFrameBuffer::RelayFrameBuffer(rtc::scoped_refptr<VideoRelaySource> source, const webrtc::EncodedImage& image, webrtc::VideoCodecType codec, int width, int height, uint64_t sequence) :
+	_source(std::move(source)),
+	_image(image),
+	_codec(codec),
+	_width(width),
+	_height(height),
+	_sequence(sequence)
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffers.insert(this);
+}
+
+RelayFrameBuffer::~RelayFrameBuffer() {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffers.erase(this);
+}
+
+const RelayFrameBuffer* RelayFrameBuffer::From(const webrtc::VideoFrameBuffer* buffer) {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	return buffers.count(buffer) ? static_cast<const RelayFrameBuffer*>(buffer) : nullptr;
+}
+
+webrtc::VideoFrameBuffer::Type RelayFrameBuffer::type() const {
+	return Type::kNative;
+}
+
+int RelayFrameBuffer::width() const {
+	return _width;
+}
+
+int RelayFrameBuffer::height() const {
+	return _height;
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> RelayFrameBuffer::ToI420() {
+	auto buffer = webrtc::I420Buffer::Create(_width, _height);
+	webrtc::I420Buffer::SetBlack(buffer.get());
+	return buffer;
+}
+
+VideoRelaySource* RelayFrameBuffer::Source() const {
+	return _source.get();
+}
+
+const webrtc::EncodedImage& RelayFrameBuffer::Image() const {
+	return _image;
+}
+
+webrtc::VideoCodecType RelayFrameBuffer::Codec() const {
+	return _codec;
+}
+
+bool RelayFrameBuffer::KeyFrame() const {
+	return _image._frameType == webrtc::VideoFrameType::kVideoFrameKey;
+}
+
+uint64_t RelayFrameBuffer::Sequence() const {
+	return _sequence;
+}
+
+VideoRelaySource::VideoRelaySource(int keyFrameIntervalMs) :
+	_key_frame_interval_ms(keyFrameIntervalMs),
+	_codec(webrtc::kVideoCodecGeneric),
+	_key_frame_requested(false),
+	_last_request_ms(-1),
+	_offset_us(0),
+	_last_us(-1),
+	_width(0),
+	_height(0),
+	_sequence(0)
+{ }
+
+bool VideoRelaySource::Push(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec) {
+	bool keyFrame = image._frameType == webrtc::VideoFrameType::kVideoFrameKey;
+	int64_t now = rtc::TimeMicros();
+	webrtc::VideoFrame::Builder builder;
+	bool deliver = false;
+
+	SetCodec(codec);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// Only key frames are guaranteed to carry the resolution.
+		if (image._encodedWidth && image._encodedHeight) {
+			_width = image._encodedWidth;
+			_height = image._encodedHeight;
+		}
+
+		if (!_width || !_height) {
+			_key_frame_requested = true;
+		}
+		else {
+			int64_t rtpUs = _unwrapper.Unwrap(image.RtpTimestamp()) * 1000 / 90;
+			int64_t timestamp = rtpUs + _offset_us;
+
+			if (_last_us < 0 || timestamp <= _last_us || std::abs(timestamp - now) > kResyncUs) {
+				timestamp = std::max(now, _last_us + 1);
+				_offset_us = timestamp - rtpUs;
+			}
+
+			_last_us = timestamp;
+			deliver = true;
+
+			builder.set_video_frame_buffer(rtc::make_ref_counted<RelayFrameBuffer>(rtc::scoped_refptr<VideoRelaySource>(this), image, codec, _width, _height, ++_sequence))
+				.set_timestamp_us(timestamp)
+				.set_rotation(image.rotation_);
+		}
+	}
+
+	if (deliver) {
+		// Answers every request made so far, those made by encoders that receive it wait for the next one.
+		if (keyFrame) {
+			_key_frame_requested = false;
+		}
+
+		OnFrame(builder.build());
+	}
+
+	return TakeKeyFrameRequest();
+}
+
+void VideoRelaySource::SetCodec(webrtc::VideoCodecType codec) {
+	_codec.store(codec, std::memory_order_relaxed);
+}
+
+webrtc::VideoCodecType VideoRelaySource::Codec() const {
+	return static_cast<webrtc::VideoCodecType>(_codec.load(std::memory_order_relaxed));
+}
+
+void VideoRelaySource::RequestKeyFrame() {
+	_key_frame_requested.store(true, std::memory_order_relaxed);
+}
+
+bool VideoRelaySource::TakeKeyFrameRequest() {
+	if (!_key_frame_requested.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	int64_t now = rtc::TimeMillis();
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_last_request_ms >= 0 && now - _last_request_ms < _key_frame_interval_ms) {
+		return false;
+	}
+
+	_last_request_ms = now;
+	_key_frame_requested.store(false, std::memory_order_relaxed);
+	return true;
+}
+
+webrtc::MediaSourceInterface::SourceState VideoRelaySource::state() const {
+	return kLive;
+}
+
+bool VideoRelaySource::remote() const {
+	return false;
+}
+
+bool VideoRelaySource::is_screencast() const {
+	return false;
+}
+
+absl::optional<bool> VideoRelaySource::needs_denoising() const {
+	return false;
+}
+
+VideoRelayTrack::VideoRelayTrack(rtc::scoped_refptr<webrtc::VideoTrackInterface> track, rtc::scoped_refptr<VideoRelaySource> source) :
+	MediaStreamTrackInternal(track.get()),
+	_source(std::move(source))
+{ }
+
+std::shared_ptr<VideoRelayTrack> VideoRelayTrack::New(rtc::scoped_refptr<VideoRelaySource> source) {
+	auto& relay = RelayFactory::Instance();
+
+	if (!relay.factory) {
+		return nullptr;
+	}
+
+	auto track = relay.factory->CreateVideoTrack(source, rtc::CreateRandomUuid());
+
+	if (!track) {
+		return nullptr;
+	}
+
+	return std::make_shared<VideoRelayTrack>(track, std::move(source));
+}
+
+VideoRelaySource* VideoRelayTrack::Source() const {
+	return _source.get();
+}
+
+void VideoRelayTrack::OnFrame(const webrtc::VideoFrame& frame) {
+	(void)frame;
+}
+
+RelayVideoEncoder::RelayVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder) :
+	_encoder(std::move(encoder)),
+	_callback(nullptr),
+	_initialized(false),
+	_relaying(false),
+	_waiting_for_key_frame(true),
+	_mismatch_logged(false),
+	_sequence(0)
+{ }
+
+RelayVideoEncoder::~RelayVideoEncoder() {
+
+}
+
+void RelayVideoEncoder::SetFecControllerOverride(webrtc::FecControllerOverride* fec_controller_override) {
+	_encoder->SetFecControllerOverride(fec_controller_override);
+}
+
+int32_t RelayVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings, const webrtc::VideoEncoder::Settings& settings) {
+	if (!codec_settings) {
+		return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+	}
+
+	_codec = *codec_settings;
+	_settings = settings;
+	_waiting_for_key_frame = true;
+	_mismatch_logged = false;
+	_sequence = 0;
+
+	// A sender already relaying starts the codec again only if the track goes back to raw frames.
+	if (_relaying) {
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	// Initialized right away so the stream encoder sees failures and can fall back to another codec.
+	int32_t result = _encoder->InitEncode(codec_settings, settings);
+	_initialized = (result == WEBRTC_VIDEO_CODEC_OK);
+
+	return result;
+}
+
+int32_t RelayVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) {
+	_callback = callback;
+	return _encoder->RegisterEncodeCompleteCallback(callback);
+}
+
+int32_t RelayVideoEncoder::Release() {
+	if (_initialized) {
+		_initialized = false;
+		return _encoder->Release();
+	}
+
+	return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t RelayVideoEncoder::Encode(const webrtc::VideoFrame& frame, const std::vector<webrtc::VideoFrameType>* frame_types) {
+	bool keyFrameRequested = frame_types && std::find(frame_types->begin(), frame_types->end(), webrtc::VideoFrameType::kVideoFrameKey) != frame_types->end();
+	auto buffer = frame.video_frame_buffer();
+
+	if (buffer->type() == webrtc::VideoFrameBuffer::Type::kNative) {
+		if (const RelayFrameBuffer* relay = RelayFrameBuffer::From(buffer.get())) {
+			return Relay(frame, *relay, keyFrameRequested);
+		}
+	}
+
+	if (!_initialized) {
+		if (!_settings) {
+			return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+		}
+
+		int32_t result = _encoder->InitEncode(&_codec, *_settings);
+
+		if (result != WEBRTC_VIDEO_CODEC_OK) {
+			return result;
+		}
+
+		_encoder->RegisterEncodeCompleteCallback(_callback);
+
+		if (_rates.framerate_fps > 0) {
+			_encoder->SetRates(_rates);
+		}
+
+		_initialized = true;
+		_relaying = false;
+	}
+
+	return _encoder->Encode(frame, frame_types);
+}
+
+void RelayVideoEncoder::SetRates(const RateControlParameters& parameters) {
+	_rates = parameters;
+
+	if (_initialized) {
+		_encoder->SetRates(parameters);
+	}
+}
+
+void RelayVideoEncoder::OnPacketLossRateUpdate(float packet_loss_rate) {
+	if (_initialized) {
+		_encoder->OnPacketLossRateUpdate(packet_loss_rate);
+	}
+}
+
+void RelayVideoEncoder::OnRttUpdate(int64_t rtt_ms) {
+	if (_initialized) {
+		_encoder->OnRttUpdate(rtt_ms);
+	}
+}
+
+void RelayVideoEncoder::OnLossNotification(const LossNotification& loss_notification) {
+	if (_initialized) {
+		_encoder->OnLossNotification(loss_notification);
+	}
+}
+
+webrtc::VideoEncoder::EncoderInfo RelayVideoEncoder::GetEncoderInfo() const {
+	if (_relaying) {
+		// Keeps the stream from being scaled or dropped for quality, the encoder has no say in either.
+		EncoderInfo info;
+
+		info.implementation_name = "Relay";
+		info.supports_native_handle = true;
+		info.has_trusted_rate_controller = true;
+		info.scaling_settings = ScalingSettings::kOff;
+
+		return info;
+	}
+
+	EncoderInfo info = _encoder->GetEncoderInfo();
+	info.supports_native_handle = true;
+	return info;
+}
+
+int32_t RelayVideoEncoder::Relay(const webrtc::VideoFrame& frame, const RelayFrameBuffer& buffer, bool keyFrameRequested) {
+	if (!_callback) {
+		return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+	}
+
+	// The track was replaced by a relay track.
+	if (_initialized) {
+		_encoder->Release();
+		_initialized = false;
+	}
+
+	_relaying = true;
+
+	if (buffer.Codec() != _codec.codecType) {
+		if (!_mismatch_logged) {
+			RTC_LOG(LS_WARNING) << "Dropping relayed " << webrtc::CodecTypeToPayloadString(buffer.Codec()) << " frames, the connection sends " << webrtc::CodecTypeToPayloadString(_codec.codecType);
+			_mismatch_logged = true;
+		}
+
+		_callback->OnDroppedFrame(webrtc::EncodedImageCallback::DropReason::kDroppedByEncoder);
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	// Frames dropped before reaching the encoder leave the ones after them without their references.
+	if (_sequence && buffer.Sequence() != _sequence + 1) {
+		_waiting_for_key_frame = true;
+	}
+
+	_sequence = buffer.Sequence();
+
+	if (keyFrameRequested || _waiting_for_key_frame) {
+		buffer.Source()->RequestKeyFrame();
+	}
+
+	if (_waiting_for_key_frame && !buffer.KeyFrame()) {
+		_callback->OnDroppedFrame(webrtc::EncodedImageCallback::DropReason::kDroppedByEncoder);
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	_waiting_for_key_frame = false;
+
+	// Stamped by this connection, the RTP timestamp follows the capture time given by the relay source.
+	webrtc::EncodedImage image = buffer.Image();
+
+	image.SetRtpTimestamp(frame.rtp_timestamp());
+	image.SetSpatialIndex(absl::nullopt);
+	image.capture_time_ms_ = frame.render_time_ms();
+	image.ntp_time_ms_ = frame.ntp_time_ms();
+	image._encodedWidth = frame.width();
+	image._encodedHeight = frame.height();
+	image.rotation_ = frame.rotation();
+	image.qp_ = -1;
+
+	webrtc::CodecSpecificInfo info = CodecInfo(buffer.Codec(), buffer.KeyFrame());
+	_callback->OnEncodedImage(image, &info);
+
+	return WEBRTC_VIDEO_CODEC_OK;
+}
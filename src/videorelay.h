@@ -0,0 +1,138 @@
+#ifndef CRTC_VIDEORELAY_H
+#define CRTC_VIDEORELAY_H
+
+#include "mediastreamtrack.h"
+#include "api/video/encoded_image.h"
+#include "api/video/video_frame_buffer.h"
+#include "api/video_codecs/video_encoder.h"
+#include "media/base/adapted_video_track_source.h"
+#include "rtc_base/numerics/sequence_number_unwrapper.h"
+#include <atomic>
+#include <mutex>
+
+namespace crtc {
+	class VideoRelaySource;
+
+	// Carries an encoded frame through a video track, from the bypass decoder of the receiving connection to
+	// the encoders of the sending ones. The library creates no other native buffers. Converting it gives a
+	// black frame of the same size.
+	class RelayFrameBuffer : public webrtc::VideoFrameBuffer {
+	public:
+		RelayFrameBuffer(rtc::scoped_refptr<VideoRelaySource> source, const webrtc::EncodedImage& image, webrtc::VideoCodecType codec, int width, int height, uint64_t sequence);
+		~RelayFrameBuffer() override;
+
+		// The relay buffer behind buffer, nullptr for every other buffer. WebRTC is built without RTTI, native
+		// buffers of capturers and applications can't be told apart with dynamic_cast.
+		static const RelayFrameBuffer* From(const webrtc::VideoFrameBuffer* buffer);
+
+		Type type() const override;
+		int width() const override;
+		int height() const override;
+		rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+		VideoRelaySource* Source() const;
+		const webrtc::EncodedImage& Image() const;
+		webrtc::VideoCodecType Codec() const;
+		bool KeyFrame() const;
+		uint64_t Sequence() const;
+
+	private:
+		rtc::scoped_refptr<VideoRelaySource> _source;
+		webrtc::EncodedImage _image;
+		webrtc::VideoCodecType _codec;
+		int _width;
+		int _height;
+		uint64_t _sequence;
+	};
+
+	// Source of a relay track, fed by the bypass decoder of the receiving connection. Frames are stamped on the
+	// local clock, keeping the spacing of the sender's RTP timestamps.
+	class VideoRelaySource : public rtc::AdaptedVideoTrackSource {
+	public:
+		explicit VideoRelaySource(int keyFrameIntervalMs);
+
+		// Returns true when the remote peer should be asked for a key frame.
+		bool Push(const webrtc::EncodedImage& image, webrtc::VideoCodecType codec);
+
+		void SetCodec(webrtc::VideoCodecType codec);
+		webrtc::VideoCodecType Codec() const;
+
+		// Merged until the next frame is pushed, and passed on at most once per key frame interval.
+		void RequestKeyFrame();
+
+		SourceState state() const override;
+		bool remote() const override;
+		bool is_screencast() const override;
+		absl::optional<bool> needs_denoising() const override;
+
+	private:
+		bool TakeKeyFrameRequest();
+
+		int _key_frame_interval_ms;
+		std::atomic<int> _codec;
+		std::atomic<bool> _key_frame_requested;
+		int64_t _last_request_ms;
+
+		std::mutex _mutex;
+		webrtc::RtpTimestampUnwrapper _unwrapper;
+		int64_t _offset_us;
+		int64_t _last_us;
+		int _width;
+		int _height;
+		uint64_t _sequence;
+	};
+
+	class VideoRelayTrack : public MediaStreamTrackInternal {
+	public:
+		VideoRelayTrack(rtc::scoped_refptr<webrtc::VideoTrackInterface> track, rtc::scoped_refptr<VideoRelaySource> source);
+
+		// Builds the track on threads owned by the library rather than by the publishing connection, subscribers
+		// keep using it after the publisher is gone. Returns nullptr when the track can't be created.
+		static std::shared_ptr<VideoRelayTrack> New(rtc::scoped_refptr<VideoRelaySource> source);
+
+		VideoRelaySource* Source() const;
+
+	protected:
+		// The frames carry no picture, onVideo() is never called.
+		void OnFrame(const webrtc::VideoFrame& frame) override;
+
+	private:
+		rtc::scoped_refptr<VideoRelaySource> _source;
+	};
+
+	// Wraps every encoder of the factory. Relayed frames are handed to the packetizer as they are, after waiting
+	// for a key frame when the stream starts or frames were dropped before reaching the encoder. The codec is
+	// initialized by InitEncode() as usual and released by the first relayed frame.
+	class RelayVideoEncoder : public webrtc::VideoEncoder {
+	public:
+		explicit RelayVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder);
+		~RelayVideoEncoder() override;
+
+		void SetFecControllerOverride(webrtc::FecControllerOverride* fec_controller_override) override;
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings, const webrtc::VideoEncoder::Settings& settings) override;
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+		int32_t Release() override;
+		int32_t Encode(const webrtc::VideoFrame& frame, const std::vector<webrtc::VideoFrameType>* frame_types) override;
+		void SetRates(const RateControlParameters& parameters) override;
+		void OnPacketLossRateUpdate(float packet_loss_rate) override;
+		void OnRttUpdate(int64_t rtt_ms) override;
+		void OnLossNotification(const LossNotification& loss_notification) override;
+		EncoderInfo GetEncoderInfo() const override;
+
+	private:
+		int32_t Relay(const webrtc::VideoFrame& frame, const RelayFrameBuffer& buffer, bool keyFrameRequested);
+
+		std::unique_ptr<webrtc::VideoEncoder> _encoder;
+		webrtc::EncodedImageCallback* _callback;
+		webrtc::VideoCodec _codec;
+		absl::optional<webrtc::VideoEncoder::Settings> _settings;
+		RateControlParameters _rates;
+		bool _initialized;
+		bool _relaying;
+		bool _waiting_for_key_frame;
+		bool _mismatch_logged;
+		uint64_t _sequence;
+	};
+}
+
+#endif